@@ -0,0 +1,71 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BTService_PacificatorEnemyPosition.h"
+#include "BehaviorTree/BlackboardComponent.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Object.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
+#include "GameFramework/Character.h"
+#include "GameFramework/CharacterMovementComponent.h"
+
+UBTService_PacificatorEnemyPosition::UBTService_PacificatorEnemyPosition()
+{
+	NodeName = TEXT("Pacificator Enemy Position");
+
+	// Same pace as the turret sight pass, the target can't change faster than that anyway
+	Interval = 0.1f;
+	RandomDeviation = 0.f;
+	bNotifyBecomeRelevant = true;
+
+	EnemyKey.AddObjectFilter(this, GET_MEMBER_NAME_CHECKED(UBTService_PacificatorEnemyPosition, EnemyKey), AActor::StaticClass());
+	EnemyKey.SelectedKeyName = TEXT("Enemy");
+
+	EnemyPositionKey.AddVectorFilter(this, GET_MEMBER_NAME_CHECKED(UBTService_PacificatorEnemyPosition, EnemyPositionKey));
+	EnemyPositionKey.SelectedKeyName = TEXT("EnemyPosition");
+}
+
+void UBTService_PacificatorEnemyPosition::InitializeFromAsset(UBehaviorTree& Asset)
+{
+	Super::InitializeFromAsset(Asset);
+
+	if (const UBlackboardData* BlackboardAsset = GetBlackboardAsset())
+	{
+		EnemyKey.ResolveSelectedKey(*BlackboardAsset);
+		EnemyPositionKey.ResolveSelectedKey(*BlackboardAsset);
+	}
+}
+
+void UBTService_PacificatorEnemyPosition::OnBecomeRelevant(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory)
+{
+	Super::OnBecomeRelevant(OwnerComp, NodeMemory);
+
+	// Don't aim at a stale position until the first interval has passed
+	UpdateEnemyPosition(OwnerComp);
+}
+
+void UBTService_PacificatorEnemyPosition::TickNode(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, float DeltaSeconds)
+{
+	Super::TickNode(OwnerComp, NodeMemory, DeltaSeconds);
+
+	UpdateEnemyPosition(OwnerComp);
+}
+
+void UBTService_PacificatorEnemyPosition::UpdateEnemyPosition(UBehaviorTreeComponent& OwnerComp) const
+{
+	UBlackboardComponent* Blackboard = OwnerComp.GetBlackboardComponent();
+	const AActor* Enemy = Blackboard ? Cast<AActor>(Blackboard->GetValue<UBlackboardKeyType_Object>(EnemyKey.GetSelectedKeyID())) : nullptr;
+	if (!Enemy)
+		return;
+
+	// Where movement last put the character, like the Blueprint task read it
+	const ACharacter* EnemyCharacter = Cast<ACharacter>(Enemy);
+	const FVector Position = EnemyCharacter && EnemyCharacter->GetCharacterMovement() ? EnemyCharacter->GetCharacterMovement()->GetLastUpdateLocation() : Enemy->GetActorLocation();
+
+	// The blackboard only notifies the controller when the value actually changes
+	Blackboard->SetValue<UBlackboardKeyType_Vector>(EnemyPositionKey.GetSelectedKeyID(), Position);
+}
+
+FString UBTService_PacificatorEnemyPosition::GetStaticDescription() const
+{
+	return FString::Printf(TEXT("%s: %s -> %s"), *Super::GetStaticDescription(), *EnemyKey.SelectedKeyName.ToString(), *EnemyPositionKey.SelectedKeyName.ToString());
+}
@@ -0,0 +1,38 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BehaviorTree/BTService.h"
+#include "BTService_PacificatorEnemyPosition.generated.h"
+
+/**
+ * Keeps the enemy's position in the blackboard up to date while the branch it sits on is active.
+ * Native replacement of the BTTask_GetEnemyPosition Blueprint task and the wait loop around it.
+ */
+UCLASS()
+class RUNFROMCAMERA_API UBTService_PacificatorEnemyPosition : public UBTService
+{
+	GENERATED_BODY()
+
+public:
+	UBTService_PacificatorEnemyPosition();
+
+	virtual void InitializeFromAsset(UBehaviorTree& Asset) override;
+
+	virtual FString GetStaticDescription() const override;
+
+protected:
+	virtual void OnBecomeRelevant(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory) override;
+
+	virtual void TickNode(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory, float DeltaSeconds) override;
+
+	UPROPERTY(EditAnywhere, Category = "Blackboard")
+	FBlackboardKeySelector EnemyKey;
+
+	UPROPERTY(EditAnywhere, Category = "Blackboard")
+	FBlackboardKeySelector EnemyPositionKey;
+
+private:
+	void UpdateEnemyPosition(UBehaviorTreeComponent& OwnerComp) const;
+};
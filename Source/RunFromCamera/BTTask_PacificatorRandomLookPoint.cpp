@@ -0,0 +1,41 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BTTask_PacificatorRandomLookPoint.h"
+#include "AIController.h"
+#include "BehaviorTree/BlackboardComponent.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
+#include "Pacificator.h"
+
+UBTTask_PacificatorRandomLookPoint::UBTTask_PacificatorRandomLookPoint()
+{
+	NodeName = TEXT("Pacificator Random Look Point");
+
+	LookPointKey.AddVectorFilter(this, GET_MEMBER_NAME_CHECKED(UBTTask_PacificatorRandomLookPoint, LookPointKey));
+	LookPointKey.SelectedKeyName = TEXT("RandomPosition");
+}
+
+void UBTTask_PacificatorRandomLookPoint::InitializeFromAsset(UBehaviorTree& Asset)
+{
+	Super::InitializeFromAsset(Asset);
+
+	if (const UBlackboardData* BlackboardAsset = GetBlackboardAsset())
+		LookPointKey.ResolveSelectedKey(*BlackboardAsset);
+}
+
+EBTNodeResult::Type UBTTask_PacificatorRandomLookPoint::ExecuteTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory)
+{
+	const AAIController* Controller = OwnerComp.GetAIOwner();
+	APacificator* Pacificator = Controller ? Cast<APacificator>(Controller->GetPawn()) : nullptr;
+	UBlackboardComponent* Blackboard = OwnerComp.GetBlackboardComponent();
+	if (!Pacificator || !Blackboard)
+		return EBTNodeResult::Failed;
+
+	Blackboard->SetValue<UBlackboardKeyType_Vector>(LookPointKey.GetSelectedKeyID(), Pacificator->GetNextLookPoint());
+	return EBTNodeResult::Succeeded;
+}
+
+FString UBTTask_PacificatorRandomLookPoint::GetStaticDescription() const
+{
+	return FString::Printf(TEXT("%s: %s"), *Super::GetStaticDescription(), *LookPointKey.SelectedKeyName.ToString());
+}
@@ -0,0 +1,30 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BehaviorTree/BTTaskNode.h"
+#include "BTTask_PacificatorRandomLookPoint.generated.h"
+
+/**
+ * Writes the next point of the controlled Pacificator's precomputed search pattern to the blackboard.
+ * Native replacement of the BTTask_RandomLookPoint Blueprint task.
+ */
+UCLASS()
+class RUNFROMCAMERA_API UBTTask_PacificatorRandomLookPoint : public UBTTaskNode
+{
+	GENERATED_BODY()
+
+public:
+	UBTTask_PacificatorRandomLookPoint();
+
+	virtual EBTNodeResult::Type ExecuteTask(UBehaviorTreeComponent& OwnerComp, uint8* NodeMemory) override;
+
+	virtual void InitializeFromAsset(UBehaviorTree& Asset) override;
+
+	virtual FString GetStaticDescription() const override;
+
+protected:
+	UPROPERTY(EditAnywhere, Category = "Blackboard")
+	FBlackboardKeySelector LookPointKey;
+};
@@ -0,0 +1,227 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BulletCamFocusSubsystem.h"
+#include "RunFromCamera.h"
+#include "Pacificator.h"
+#include "PacificatorSubsystem.h"
+#include "Projectile.h"
+#include "ProjectilePoolSubsystem.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/HUD.h"
+#include "Camera/PlayerCameraManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Bullet Cam Focus"), STAT_BulletCamFocus, STATGROUP_RunFromCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Bullet Cam Throttled Ticks"), STAT_BulletCamThrottledTicks, STATGROUP_RunFromCamera);
+
+static TAutoConsoleVariable<bool> CVarBulletCamFocusEnabled(
+	TEXT("RunFromCamera.BulletCam.Focus"),
+	true,
+	TEXT("Throttle the ticks of everything the followed bullet can't reach or see while the bullet cam is running."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarBulletCamFocusRadius(
+	TEXT("RunFromCamera.BulletCam.FocusRadius"),
+	1500.f,
+	TEXT("Actors closer than this to the followed bullet's path keep ticking normally during bullet cam."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarBulletCamFocusTickInterval(
+	TEXT("RunFromCamera.BulletCam.FocusTickInterval"),
+	0.1f,
+	TEXT("Tick interval in dilated seconds of actors outside the bullet cam focus. 0 suspends them until bullet cam ends."),
+	ECVF_Default);
+
+void UBulletCamFocusSubsystem::Deinitialize()
+{
+	EndFocus();
+
+	Super::Deinitialize();
+}
+
+bool UBulletCamFocusSubsystem::DoesSupportWorldType(EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UBulletCamFocusSubsystem::BeginFocus(const AActor* FollowedActor, const FVector& PathStart, const FVector& PathEnd, float ViewFOV)
+{
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_BulletCamFocus);
+
+	// A bullet cam started over a running one keeps the original state to restore
+	EndFocus();
+
+	if (!CVarBulletCamFocusEnabled.GetValueOnGameThread())
+		return;
+
+	UWorld* World = GetWorld();
+	if (!World)
+		return;
+
+	FocusStart = PathStart;
+	FocusEnd = PathEnd;
+	FocusRadius = FMath::Max(CVarBulletCamFocusRadius.GetValueOnGameThread(), 0.f);
+	ViewDistance = FVector::Dist(PathStart, PathEnd) + FocusRadius;
+	CosHalfViewAngle = FMath::Cos(FMath::DegreesToRadians(FMath::Min(ViewFOV * 0.5f + 15.f, 180.f)));
+	AppliedInterval = FMath::Max(CVarBulletCamFocusTickInterval.GetValueOnGameThread(), 0.f);
+
+	AlwaysInFocus.Add(FollowedActor);
+	if (FollowedActor)
+	{
+		AlwaysInFocus.Add(FollowedActor->GetOwner());
+		AlwaysInFocus.Add(FollowedActor->GetInstigator());
+	}
+
+	for (FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It; ++It)
+	{
+		if (const APlayerController* PlayerController = It->Get())
+		{
+			AlwaysInFocus.Add(PlayerController);
+			AlwaysInFocus.Add(PlayerController->GetPawn());
+			AlwaysInFocus.Add(PlayerController->PlayerCameraManager);
+			AlwaysInFocus.Add(PlayerController->GetHUD());
+		}
+	}
+
+	bFocusActive = true;
+
+	// Only what the game keeps registries of ticks in numbers worth throttling: the turrets with their controllers,
+	// the bullets in flight and the other pawns the turrets look for
+	if (const UPacificatorSubsystem* PacificatorSubsystem = World->GetSubsystem<UPacificatorSubsystem>())
+	{
+		for (APacificator* Pacificator : PacificatorSubsystem->GetPacificators())
+		{
+			ThrottleActor(Pacificator);
+			if (Pacificator)
+				ThrottleActor(Pacificator->GetController());
+		}
+
+		for (APawn* Target : PacificatorSubsystem->GetSightTargets())
+		{
+			ThrottleActor(Target);
+			if (Target)
+				ThrottleActor(Target->GetController());
+		}
+	}
+
+	if (const UProjectilePoolSubsystem* Pool = World->GetSubsystem<UProjectilePoolSubsystem>())
+	{
+		for (AProjectile* Projectile : Pool->GetActiveProjectiles())
+			ThrottleActor(Projectile);
+	}
+
+	SET_DWORD_STAT(STAT_BulletCamThrottledTicks, ThrottledTicks.Num());
+}
+
+void UBulletCamFocusSubsystem::EndFocus()
+{
+	if (!bFocusActive)
+		return;
+
+	int32 NumRestored = 0;
+	for (const FThrottledTick& Throttled : ThrottledTicks)
+	{
+		if (!Throttled.Owner.IsValid() || !Throttled.TickFunction->IsTickFunctionRegistered())
+			continue;
+
+		FTickFunction& TickFunction = *Throttled.TickFunction;
+		bool bRestored = false;
+
+		// Whatever the owner decided on its own during the bullet cam wins over the saved state
+		if (AppliedInterval > 0.f && TickFunction.TickInterval == AppliedInterval)
+		{
+			TickFunction.UpdateTickIntervalAndCoolDown(Throttled.OriginalInterval);
+			bRestored = true;
+		}
+		else if (AppliedInterval <= 0.f && Throttled.bWasEnabled && !TickFunction.IsTickFunctionEnabled())
+		{
+			TickFunction.SetTickFunctionEnable(true);
+			bRestored = true;
+		}
+
+		if (bRestored)
+			++NumRestored;
+	}
+
+	UE_LOG(LogRunFromCamera, Verbose, TEXT("Bullet cam focus restored %d of %d throttled ticks"), NumRestored, ThrottledTicks.Num());
+
+	ThrottledTicks.Reset();
+	AlwaysInFocus.Reset();
+	bFocusActive = false;
+
+	SET_DWORD_STAT(STAT_BulletCamThrottledTicks, 0);
+}
+
+bool UBulletCamFocusSubsystem::IsInFocus(const AActor* Actor) const
+{
+	if (AlwaysInFocus.Contains(Actor))
+		return true;
+
+	// Controllers don't follow their pawn around, where the pawn is decides for them
+	const AActor* LocatedActor = Actor;
+	if (const AController* Controller = Cast<AController>(Actor))
+		LocatedActor = Controller->GetPawn();
+
+	// Game mode, game state and other actors without a place in the world are left alone
+	const USceneComponent* Root = LocatedActor ? LocatedActor->GetRootComponent() : nullptr;
+	if (!Root)
+		return true;
+
+	const FVector Location = Root->GetComponentLocation();
+	const float Radius = FocusRadius + Root->Bounds.SphereRadius;
+	if (FMath::PointDistToSegmentSquared(Location, FocusStart, FocusEnd) <= FMath::Square(Radius))
+		return true;
+
+	// The camera trails the bullet looking down its path, so anything in that cone can end up on screen
+	const FVector ToActor = Location - FocusStart;
+	const float Distance = ToActor.Size();
+	if (Distance > ViewDistance + Root->Bounds.SphereRadius)
+		return false;
+
+	const FVector PathDirection = (FocusEnd - FocusStart).GetSafeNormal();
+	return Distance <= KINDA_SMALL_NUMBER || FVector::DotProduct(ToActor / Distance, PathDirection) >= CosHalfViewAngle;
+}
+
+void UBulletCamFocusSubsystem::ThrottleActor(AActor* Actor)
+{
+	if (!IsValid(Actor) || IsInFocus(Actor))
+		return;
+
+	Throttle(Actor, Actor->PrimaryActorTick);
+
+	for (UActorComponent* Component : Actor->GetComponents())
+	{
+		if (Component)
+			Throttle(Component, Component->PrimaryComponentTick);
+	}
+}
+
+void UBulletCamFocusSubsystem::Throttle(UObject* Owner, FTickFunction& TickFunction)
+{
+	if (!TickFunction.bCanEverTick || !TickFunction.IsTickFunctionRegistered())
+		return;
+
+	FThrottledTick Throttled;
+	Throttled.Owner = Owner;
+	Throttled.TickFunction = &TickFunction;
+	Throttled.OriginalInterval = TickFunction.TickInterval;
+	Throttled.bWasEnabled = TickFunction.IsTickFunctionEnabled();
+
+	if (AppliedInterval > 0.f)
+	{
+		// Disabled ticks are throttled too, so one that switches itself on during the bullet cam still runs slow
+		if (TickFunction.TickInterval >= AppliedInterval)
+			return;
+
+		TickFunction.UpdateTickIntervalAndCoolDown(AppliedInterval);
+	}
+	else
+	{
+		if (!Throttled.bWasEnabled)
+			return;
+
+		TickFunction.SetTickFunctionEnable(false);
+	}
+
+	ThrottledTicks.Add(Throttled);
+}
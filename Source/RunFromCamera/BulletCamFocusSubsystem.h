@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "BulletCamFocusSubsystem.generated.h"
+
+/**
+ * Focus mode for the bullet cam. While the followed bullet flies from the muzzle to its target, every turret,
+ * bullet and sight target that is neither near that path nor inside the bullet camera's view cone has its actor
+ * and component ticks throttled to RunFromCamera.BulletCam.FocusTickInterval, or suspended when that is 0.
+ * Ending the focus puts each tick function back exactly as it was, unless its owner changed it in the meantime.
+ */
+UCLASS()
+class RUNFROMCAMERA_API UBulletCamFocusSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	// Throttles everything that can't affect the bullet flying from PathStart to PathEnd or be seen following it
+	void BeginFocus(const AActor* FollowedActor, const FVector& PathStart, const FVector& PathEnd, float ViewFOV);
+
+	void EndFocus();
+
+	bool IsFocusActive() const { return bFocusActive; }
+
+protected:
+	virtual bool DoesSupportWorldType(EWorldType::Type WorldType) const override;
+
+private:
+	struct FThrottledTick
+	{
+		// Keeps TickFunction from being touched once its actor or component is gone
+		TWeakObjectPtr<UObject> Owner;
+
+		FTickFunction* TickFunction = nullptr;
+
+		float OriginalInterval = 0.f;
+
+		bool bWasEnabled = false;
+	};
+
+	bool IsInFocus(const AActor* Actor) const;
+
+	// Throttles the actor and its components unless it is in focus
+	void ThrottleActor(AActor* Actor);
+
+	void Throttle(UObject* Owner, FTickFunction& TickFunction);
+
+	TArray<FThrottledTick> ThrottledTicks;
+
+	// Actors that are never throttled: the bullet, whoever fired it and the local players
+	TSet<const AActor*> AlwaysInFocus;
+
+	FVector FocusStart = FVector::ZeroVector;
+
+	FVector FocusEnd = FVector::ZeroVector;
+
+	float FocusRadius = 0.f;
+
+	float CosHalfViewAngle = 0.f;
+
+	float ViewDistance = 0.f;
+
+	// Interval applied while focused, 0 when ticks are suspended instead
+	float AppliedInterval = 0.f;
+
+	bool bFocusActive = false;
+};
@@ -0,0 +1,57 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "BulletCamRig.h"
+#include "Projectile.h"
+#include "GameFramework/SpringArmComponent.h"
+#include "Camera/CameraComponent.h"
+
+// Sets default values
+ABulletCamRig::ABulletCamRig()
+{
+	PrimaryActorTick.bCanEverTick = false;
+
+	CameraBoom = CreateDefaultSubobject<USpringArmComponent>(TEXT("CameraBoom"));
+	CameraBoom->TargetArmLength = DefaultArmLength;
+	CameraBoom->bUsePawnControlRotation = true;
+	RootComponent = CameraBoom;
+
+	BulletCam = CreateDefaultSubobject<UCameraComponent>(TEXT("BulletCam"));
+	BulletCam->SetupAttachment(CameraBoom, USpringArmComponent::SocketName);
+	BulletCam->bUsePawnControlRotation = false;
+	BulletCam->bAutoActivate = false;
+
+	// Nothing to update while no bullet is being followed
+	CameraBoom->PrimaryComponentTick.bStartWithTickEnabled = false;
+}
+
+void ABulletCamRig::AttachToProjectile(AProjectile* Projectile)
+{
+	if (!Projectile)
+		return;
+
+	DetachFromProjectile();
+
+	AttachedProjectile = Projectile;
+	Projectile->CameraBoom = CameraBoom;
+	Projectile->BulletCam = BulletCam;
+
+	CameraBoom->TargetArmLength = DefaultArmLength;
+	AttachToActor(Projectile, FAttachmentTransformRules::SnapToTargetNotIncludingScale);
+	CameraBoom->SetComponentTickEnabled(true);
+	BulletCam->SetActive(true);
+}
+
+void ABulletCamRig::DetachFromProjectile()
+{
+	if (AProjectile* Projectile = AttachedProjectile.Get())
+	{
+		Projectile->CameraBoom = nullptr;
+		Projectile->BulletCam = nullptr;
+	}
+	AttachedProjectile.Reset();
+
+	DetachFromActor(FDetachmentTransformRules::KeepWorldTransform);
+	CameraBoom->SetComponentTickEnabled(false);
+	BulletCam->SetActive(false);
+}
@@ -0,0 +1,42 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "BulletCamRig.generated.h"
+
+class AProjectile;
+
+/**
+ * Spring arm and camera shared by every projectile. It is attached to the one bullet picked for bullet cam
+ * and parked again once the bullet cam sequence is over.
+ */
+UCLASS()
+class RUNFROMCAMERA_API ABulletCamRig : public AActor
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this actor's properties
+	ABulletCamRig();
+
+	// Follows Projectile and exposes our components through its CameraBoom and BulletCam properties
+	void AttachToProjectile(AProjectile* Projectile);
+
+	void DetachFromProjectile();
+
+	AProjectile* GetAttachedProjectile() const { return AttachedProjectile.Get(); }
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera)
+	class USpringArmComponent* CameraBoom;
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera)
+	class UCameraComponent* BulletCam;
+
+private:
+	TWeakObjectPtr<AProjectile> AttachedProjectile;
+
+	// CameraWarp animates the arm length, so every bullet cam starts from this value
+	float DefaultArmLength = 200.0f;
+};
@@ -0,0 +1,138 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "HitEventBusSubsystem.h"
+#include "RunFromCamera.h"
+#include "RunFromCameraCharacter.h"
+#include "Pacificator.h"
+#include "SessionRecordingSubsystem.h"
+
+DECLARE_CYCLE_STAT(TEXT("Resolve Hits"), STAT_ResolveHits, STATGROUP_RunFromCamera);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Hits Resolved"), STAT_HitsResolved, STATGROUP_RunFromCamera);
+
+void UHitEventBusSubsystem::Deinitialize()
+{
+	PendingHits.Empty();
+	ResolvingHits.Empty();
+	HitsResolved.Clear();
+
+	Super::Deinitialize();
+}
+
+TStatId UHitEventBusSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UHitEventBusSubsystem, STATGROUP_Tickables);
+}
+
+bool UHitEventBusSubsystem::DoesSupportWorldType(EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+bool UHitEventBusSubsystem::QueueHit(AActor* Shooter, const FHitResult& Hit, bool bShouldBounce, bool bAuthority, bool bBulletCam)
+{
+	AActor* Victim = Hit.GetActor();
+
+	EHitVictimType VictimType = EHitVictimType::Other;
+	if (Victim && Victim->IsA<APacificator>())
+		VictimType = EHitVictimType::Pacificator;
+	else if (Victim && Victim->IsA<ARunFromCameraCharacter>())
+		VictimType = EHitVictimType::Character;
+
+	// Nothing to score and no camera to reset, a bullet hitting a wall only has to know whether it stops
+	if (VictimType != EHitVictimType::Other || bBulletCam)
+	{
+		FProjectileHitRecord& Record = PendingHits.AddDefaulted_GetRef();
+		Record.Shooter = Shooter;
+		Record.Victim = Victim;
+		Record.ImpactPoint = Hit.ImpactPoint;
+		Record.ImpactNormal = Hit.ImpactNormal;
+		Record.VictimType = VictimType;
+		Record.bBounced = bShouldBounce;
+		Record.bBulletCam = bBulletCam;
+		Record.bAuthority = bAuthority;
+	}
+
+	// A bouncing bullet that scores on a turret is used up
+	return !bShouldBounce || (VictimType == EHitVictimType::Pacificator && Shooter && Shooter->IsA<ARunFromCameraCharacter>());
+}
+
+void UHitEventBusSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (PendingHits.Num() > 0)
+		ResolveHits();
+}
+
+void UHitEventBusSubsystem::ResolveHits()
+{
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_ResolveHits);
+
+	Swap(PendingHits, ResolvingHits);
+	INC_DWORD_STAT_BY(STAT_HitsResolved, ResolvingHits.Num());
+
+	USessionRecordingSubsystem* SessionRecording = GetWorld()->GetSubsystem<USessionRecordingSubsystem>();
+
+	TArray<TPair<ARunFromCameraCharacter*, int32>, TInlineAllocator<4>> PointsByShooter;
+	TArray<ARunFromCameraCharacter*, TInlineAllocator<4>> HitCharacters;
+	TArray<ARunFromCameraCharacter*, TInlineAllocator<1>> BulletCamShooters;
+
+	for (const FProjectileHitRecord& Record : ResolvingHits)
+	{
+		ARunFromCameraCharacter* Shooter = Cast<ARunFromCameraCharacter>(Record.Shooter.Get());
+
+		if (Record.bBulletCam && Shooter)
+			BulletCamShooters.AddUnique(Shooter);
+
+		if (!Record.bAuthority)
+			continue;
+
+		if (Record.VictimType == EHitVictimType::Pacificator && Shooter)
+		{
+			if (SessionRecording)
+				SessionRecording->Record(ESessionRecordType::Hit, 0);
+
+			const int32 Points = Record.bBounced ? 5 : 1;
+			TPair<ARunFromCameraCharacter*, int32>* ShooterPoints = PointsByShooter.FindByPredicate([Shooter](const TPair<ARunFromCameraCharacter*, int32>& Pair) { return Pair.Key == Shooter; });
+			if (ShooterPoints)
+				ShooterPoints->Value += Points;
+			else
+				PointsByShooter.Emplace(Shooter, Points);
+		}
+		else if (Record.VictimType == EHitVictimType::Character)
+		{
+			ARunFromCameraCharacter* HitCharacter = Cast<ARunFromCameraCharacter>(Record.Victim.Get());
+			if (!IsValid(HitCharacter))
+				continue;
+
+			if (SessionRecording)
+				SessionRecording->Record(ESessionRecordType::Hit, 1);
+
+			HitCharacters.AddUnique(HitCharacter);
+		}
+	}
+
+	for (const TPair<ARunFromCameraCharacter*, int32>& ShooterPoints : PointsByShooter)
+	{
+		if (IsValid(ShooterPoints.Key))
+			ShooterPoints.Key->AddPoints(ShooterPoints.Value);
+	}
+
+	for (ARunFromCameraCharacter* Shooter : BulletCamShooters)
+	{
+		if (IsValid(Shooter) && Shooter->GetCurrentCamera() == ECameraType::BulletCam)
+			Shooter->ResetCameraAfterBulletCam();
+	}
+
+	HitsResolved.Broadcast(ResolvingHits);
+
+	// Deaths last, dying can end the game and nothing above should run on a torn down world
+	for (ARunFromCameraCharacter* HitCharacter : HitCharacters)
+	{
+		if (IsValid(HitCharacter))
+			HitCharacter->Die();
+	}
+
+	ResolvingHits.Reset();
+}
@@ -0,0 +1,77 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "HitEventBusSubsystem.generated.h"
+
+enum class EHitVictimType : uint8
+{
+	Other,
+	Pacificator,
+	Character
+};
+
+/**
+ * One bullet hit waiting to be resolved. Only what scoring, deaths and effects need is kept.
+ */
+struct FProjectileHitRecord
+{
+	TWeakObjectPtr<AActor> Shooter;
+
+	TWeakObjectPtr<AActor> Victim;
+
+	FVector ImpactPoint = FVector::ZeroVector;
+
+	FVector ImpactNormal = FVector::ZeroVector;
+
+	EHitVictimType VictimType = EHitVictimType::Other;
+
+	// Only third person shots bounce, so this doubles as the camera the shot was fired from
+	bool bBounced = false;
+
+	bool bBulletCam = false;
+
+	bool bAuthority = false;
+};
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnProjectileHitsResolved, TConstArrayView<FProjectileHitRecord>);
+
+/**
+ * Collects the hits of projectile actors and of bullets simulated by the projectile manager, and resolves
+ * them together once per frame: points are summed per shooter, each character dies at most once and the
+ * bullet cam is reset. Collision callbacks only classify the victim and append a record.
+ */
+UCLASS()
+class RUNFROMCAMERA_API UHitEventBusSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual TStatId GetStatId() const override;
+
+	// Queues the hit for this frame's pass and returns true when the bullet has to be removed right away.
+	// Points and deaths are only applied for hits queued with bAuthority.
+	bool QueueHit(AActor* Shooter, const FHitResult& Hit, bool bShouldBounce, bool bAuthority, bool bBulletCam = false);
+
+	// Broadcast with every hit of the pass after scoring, for effects that want the whole batch
+	FOnProjectileHitsResolved& OnHitsResolved() { return HitsResolved; }
+
+protected:
+	virtual bool DoesSupportWorldType(EWorldType::Type WorldType) const override;
+
+private:
+	void ResolveHits();
+
+	TArray<FProjectileHitRecord> PendingHits;
+
+	// Swapped with PendingHits for the pass, so hits queued by the pass itself wait for the next one
+	TArray<FProjectileHitRecord> ResolvingHits;
+
+	FOnProjectileHitsResolved HitsResolved;
+};
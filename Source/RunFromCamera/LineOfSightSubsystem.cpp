@@ -0,0 +1,157 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "LineOfSightSubsystem.h"
+#include "RunFromCamera.h"
+#include "Engine/World.h"
+#include "GameFramework/Actor.h"
+
+DECLARE_CYCLE_STAT(TEXT("Line Of Sight"), STAT_LineOfSight, STATGROUP_RunFromCamera);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Line Of Sight Traces"), STAT_LineOfSightTraces, STATGROUP_RunFromCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Line Of Sight Queued"), STAT_LineOfSightQueued, STATGROUP_RunFromCamera);
+
+static TAutoConsoleVariable<int32> CVarLineOfSightTracesPerFrame(
+	TEXT("RunFromCamera.LineOfSight.TracesPerFrame"),
+	16,
+	TEXT("Most line of sight traces run in one frame. Requests beyond that wait for the next frames."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarLineOfSightResultLifetime(
+	TEXT("RunFromCamera.LineOfSight.ResultLifetime"),
+	0.5f,
+	TEXT("Seconds a line of sight result stays valid. Older results are treated as unknown."),
+	ECVF_Default);
+
+void ULineOfSightSubsystem::Deinitialize()
+{
+	Entries.Empty();
+	HighPriorityQueue.Empty();
+	Queue.Empty();
+
+	SET_DWORD_STAT(STAT_LineOfSightQueued, 0);
+
+	Super::Deinitialize();
+}
+
+TStatId ULineOfSightSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(ULineOfSightSubsystem, STATGROUP_Tickables);
+}
+
+bool ULineOfSightSubsystem::DoesSupportWorldType(EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void ULineOfSightSubsystem::RequestLineOfSight(const AActor* Viewer, const FVector& Start, const AActor* Target, bool bHighPriority)
+{
+	if (!Viewer || !Target)
+		return;
+
+	FLineOfSightEntry& Entry = Entries.FindOrAdd(Viewer);
+	Entry.Start = Start;
+	Entry.Target = Target;
+
+	if (!Entry.bPending)
+	{
+		Entry.bPending = true;
+		Entry.bHighPriority = bHighPriority;
+		(bHighPriority ? HighPriorityQueue : Queue).Add(Viewer);
+	}
+	else if (bHighPriority && !Entry.bHighPriority)
+	{
+		// The entry in the normal queue is skipped once this one has been served
+		Entry.bHighPriority = true;
+		HighPriorityQueue.Add(Viewer);
+	}
+}
+
+bool ULineOfSightSubsystem::GetLineOfSight(const AActor* Viewer, const AActor* Target, bool& bOutVisible) const
+{
+	const FLineOfSightEntry* Entry = Entries.Find(Viewer);
+	if (!Entry || Entry->ResultTime < 0.0 || Entry->ResultTarget.Get() != Target)
+		return false;
+
+	const double Age = GetWorld()->GetTimeSeconds() - Entry->ResultTime;
+	if (Age > CVarLineOfSightResultLifetime.GetValueOnGameThread())
+		return false;
+
+	bOutVisible = Entry->bVisible;
+	return true;
+}
+
+void ULineOfSightSubsystem::Tick(float DeltaTime)
+{
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_LineOfSight);
+
+	Super::Tick(DeltaTime);
+
+	// Engaged turrets go first, whatever budget is left is shared round-robin by everybody else
+	int32 Budget = FMath::Max(CVarLineOfSightTracesPerFrame.GetValueOnGameThread(), 1);
+	Budget -= ProcessQueue(HighPriorityQueue, Budget);
+	ProcessQueue(Queue, Budget);
+
+	SET_DWORD_STAT(STAT_LineOfSightQueued, HighPriorityQueue.Num() + Queue.Num());
+
+	TimeSincePurge += DeltaTime;
+	if (TimeSincePurge > 1.f)
+	{
+		TimeSincePurge = 0.f;
+		PurgeStaleEntries();
+	}
+}
+
+int32 ULineOfSightSubsystem::ProcessQueue(TArray<TWeakObjectPtr<const AActor>>& InQueue, int32 Budget)
+{
+	int32 NumTraces = 0;
+	int32 NumServed = 0;
+	for (; NumServed < InQueue.Num() && NumTraces < Budget; ++NumServed)
+	{
+		const AActor* Viewer = InQueue[NumServed].Get();
+		FLineOfSightEntry* Entry = Viewer ? Entries.Find(Viewer) : nullptr;
+
+		// Gone, or already served through the other queue
+		if (!Entry || !Entry->bPending)
+			continue;
+
+		Trace(Viewer, *Entry);
+		++NumTraces;
+	}
+
+	// Served requests leave from the front, so whoever waited longest is next in line
+	InQueue.RemoveAt(0, NumServed, false);
+	return NumTraces;
+}
+
+void ULineOfSightSubsystem::Trace(const AActor* Viewer, FLineOfSightEntry& Entry)
+{
+	Entry.bPending = false;
+	Entry.bHighPriority = false;
+	Entry.ResultTarget = Entry.Target;
+	Entry.ResultTime = GetWorld()->GetTimeSeconds();
+	Entry.bVisible = false;
+
+	const AActor* Target = Entry.Target.Get();
+	if (!Target)
+		return;
+
+	INC_DWORD_STAT(STAT_LineOfSightTraces);
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(LineOfSight), true, Viewer);
+	FHitResult Hit;
+	const bool bBlocked = GetWorld()->LineTraceSingleByChannel(Hit, Entry.Start, Target->GetActorLocation(), ECC_Visibility, QueryParams);
+	Entry.bVisible = !bBlocked || Hit.GetActor() == Target;
+}
+
+void ULineOfSightSubsystem::PurgeStaleEntries()
+{
+	const double Now = GetWorld()->GetTimeSeconds();
+	const float Lifetime = CVarLineOfSightResultLifetime.GetValueOnGameThread();
+
+	for (auto It = Entries.CreateIterator(); It; ++It)
+	{
+		const FLineOfSightEntry& Entry = It.Value();
+		if (!It.Key().IsValid() || (!Entry.bPending && Now - Entry.ResultTime > Lifetime))
+			It.RemoveCurrent();
+	}
+}
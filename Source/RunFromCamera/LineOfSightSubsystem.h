@@ -0,0 +1,69 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "LineOfSightSubsystem.generated.h"
+
+/**
+ * Central line of sight scheduler. Viewers submit visibility requests and read back the latest result
+ * instead of tracing on the spot. Requests are served first come first served, high priority ones first,
+ * and no more than RunFromCamera.LineOfSight.TracesPerFrame of them per frame, so a crowd of turrets
+ * around the player costs the same every frame instead of spiking.
+ */
+UCLASS()
+class RUNFROMCAMERA_API ULineOfSightSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual TStatId GetStatId() const override;
+
+	// Queues a trace from Start to wherever Target is when the request is served. A viewer has at most one
+	// pending request, submitting again only updates it (and can raise its priority).
+	void RequestLineOfSight(const AActor* Viewer, const FVector& Start, const AActor* Target, bool bHighPriority);
+
+	// Latest result for Viewer looking at Target. False when there is none yet or it has expired.
+	bool GetLineOfSight(const AActor* Viewer, const AActor* Target, bool& bOutVisible) const;
+
+protected:
+	virtual bool DoesSupportWorldType(EWorldType::Type WorldType) const override;
+
+private:
+	struct FLineOfSightEntry
+	{
+		FVector Start = FVector::ZeroVector;
+
+		TWeakObjectPtr<const AActor> Target;
+
+		TWeakObjectPtr<const AActor> ResultTarget;
+
+		double ResultTime = -1.0;
+
+		bool bVisible = false;
+
+		bool bPending = false;
+
+		bool bHighPriority = false;
+	};
+
+	// Serves up to Budget requests from Queue, returns how many traces were spent
+	int32 ProcessQueue(TArray<TWeakObjectPtr<const AActor>>& Queue, int32 Budget);
+
+	void Trace(const AActor* Viewer, FLineOfSightEntry& Entry);
+
+	void PurgeStaleEntries();
+
+	TMap<TWeakObjectPtr<const AActor>, FLineOfSightEntry> Entries;
+
+	TArray<TWeakObjectPtr<const AActor>> HighPriorityQueue;
+
+	TArray<TWeakObjectPtr<const AActor>> Queue;
+
+	float TimeSincePurge = 0.f;
+};
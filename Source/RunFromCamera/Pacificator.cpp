@@ -3,6 +3,32 @@
 
 #include "Pacificator.h"
 #include "Projectile.h"
+#include "ProjectileManagerSubsystem.h"
+#include "PacificatorAIController.h"
+#include "PacificatorFieldSubsystem.h"
+#include "RunFromCamera.h"
+#include "Materials/MaterialInterface.h"
+#include "Engine/AssetManager.h"
+#include "Net/UnrealNetwork.h"
+
+DECLARE_CYCLE_STAT(TEXT("Pacificator Fire"), STAT_PacificatorFire, STATGROUP_RunFromCamera);
+
+namespace
+{
+	// Radical inverse of Index in Base, the Halton sequence for that base
+	float Halton(uint32 Index, uint32 Base)
+	{
+		float Result = 0.f;
+		float Fraction = 1.f / Base;
+		while (Index > 0)
+		{
+			Result += (Index % Base) * Fraction;
+			Index /= Base;
+			Fraction /= Base;
+		}
+		return Result;
+	}
+}
 
 // Sets default values
 APacificator::APacificator()
@@ -25,20 +51,16 @@ APacificator::APacificator()
 	MuzzlePoint = CreateDefaultSubobject<UArrowComponent>(TEXT("Muzzle"));
 	MuzzlePoint->SetupAttachment(RootComponent);
 
-	static ConstructorHelpers::FObjectFinder<UMaterialInstance>Material(TEXT("MaterialInstanceConstant'/Game/Material/Pulse_Material_Green.Pulse_Material_Green'"));
-	if (Material.Succeeded())
-	{
-		NeutralMaterial = Material.Object;
-	}
+	// Soft so loading the turret class doesn't block on its materials, the game mode streams them in with its preload bundle
+	NeutralMaterial = TSoftObjectPtr<UMaterialInterface>(FSoftObjectPath(TEXT("/Game/Material/Pulse_Material_Green.Pulse_Material_Green")));
+	EnemySpottedMaterial = TSoftObjectPtr<UMaterialInterface>(FSoftObjectPath(TEXT("/Game/Material/Pulse_Material_Red.Pulse_Material_Red")));
 
-	static ConstructorHelpers::FObjectFinder<UMaterial>SecondMaterial(TEXT("Material'/Game/Material/Pulse_Material_Red.Pulse_Material_Red'"));
-	if (SecondMaterial.Succeeded())
-	{
-		EnemySpottedMaterial = SecondMaterial.Object;
-	}
-
-	bCanShoot = true;
 	WeaponFireRate = .75f;
+
+	ProjectilePreset.CollisionProfileName = TEXT("TurretProjectile");
+
+	// Clients see the controller turn the turret, bullets themselves never replicate
+	SetReplicatingMovement(true);
 }
 
 // Called when the game starts or when spawned
@@ -46,11 +68,43 @@ void APacificator::BeginPlay()
 {
 	Super::BeginPlay();
 
-	EnemyMaterialInstance = UMaterialInstanceDynamic::Create(EnemySpottedMaterial, Light);
-	NeutralMaterialInstance = UMaterialInstanceDynamic::Create(NeutralMaterial, Light);
+	// Without a renderer the light materials are never drawn, the server doesn't even stream them in
+	if (FApp::CanEverRender())
+	{
+		//Default camera is non-aggresive
+		if (UMaterialInterface* Material = NeutralMaterial.Get())
+			Light->SetMaterial(0, Material);
+		RegisterInstancedVisuals();
+		LoadLightMaterials();
+	}
+
+	// A turret coming back from the turret field keeps the look points it had
+	if (LookPoints.Num() == 0)
+		BuildLookPoints();
+
+	// Pooled actors are only needed when the projectile manager isn't flying our bullets
+	UProjectileManagerSubsystem* ProjectileManager = GetWorld()->GetSubsystem<UProjectileManagerSubsystem>();
+	UProjectilePoolSubsystem* Pool = GetWorld()->GetSubsystem<UProjectilePoolSubsystem>();
+	if (Pool && !(ProjectileManager && ProjectileManager->IsSimulationEnabled()))
+		Pool->Prewarm(ProjectileClass, ProjectilePreset);
+
+	if (UPacificatorSubsystem* PacificatorSubsystem = GetWorld()->GetSubsystem<UPacificatorSubsystem>())
+		PacificatorSubsystem->RegisterPacificator(this);
+
+	// Last, this may destroy the turret
+	UPacificatorFieldSubsystem* TurretField = GetWorld()->GetSubsystem<UPacificatorFieldSubsystem>();
+	if (bUseTurretField && TurretField)
+		TurretField->NotifyPacificatorBeginPlay(this);
+}
 
-	//Default camera is non-aggresive
-	Light->SetMaterial(0, NeutralMaterialInstance);
+void APacificator::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (UPacificatorSubsystem* PacificatorSubsystem = GetWorld()->GetSubsystem<UPacificatorSubsystem>())
+		PacificatorSubsystem->UnregisterPacificator(this);
+
+	UnregisterInstancedVisuals();
+
+	Super::EndPlay(EndPlayReason);
 }
 
 // Called every frame
@@ -59,33 +113,254 @@ void APacificator::Tick(float DeltaTime)
 	Super::Tick(DeltaTime);
 }
 
+void APacificator::BuildLookPoints()
+{
+	const int32 NumLookPoints = FMath::Max(SearchConfig.NumLookPoints, 1);
+	LookPoints.Reset(NumLookPoints);
+
+	const FVector Origin = GetActorLocation();
+	const float FacingYaw = GetActorRotation().Yaw;
+	const float MinDistanceSquared = FMath::Square(FMath::Max(SearchConfig.MinLookDistance, 0.f));
+	const float MaxDistanceSquared = FMath::Square(FMath::Max(SearchConfig.MaxLookDistance, SearchConfig.MinLookDistance));
+
+	// Neighbouring turrets start at different places in the sequence so they don't sweep in lockstep.
+	// Hashing the name string keeps the pattern the same from run to run, which session replays rely on. The FName
+	// hash would follow the name table index, which depends on the order names were created in.
+	const uint32 SequenceOffset = FCrc::StrCrc32(*GetName()) % 4096;
+
+	for (int32 Index = 0; Index < NumLookPoints; ++Index)
+	{
+		const uint32 SequenceIndex = SequenceOffset + Index + 1;
+		const float Yaw = FacingYaw + (2.f * Halton(SequenceIndex, 2) - 1.f) * SearchConfig.LookArcHalfAngleDegrees;
+
+		// Interpolating the squared distance spreads the points evenly over the area of the ring
+		const float Distance = FMath::Sqrt(FMath::Lerp(MinDistanceSquared, MaxDistanceSquared, Halton(SequenceIndex, 3)));
+		const float HeightOffset = (2.f * Halton(SequenceIndex, 5) - 1.f) * SearchConfig.MaxLookHeightOffset;
+
+		LookPoints.Add(Origin + FRotator(0.f, Yaw, 0.f).Vector() * Distance + FVector(0.f, 0.f, HeightOffset));
+	}
+
+	NextLookPoint = 0;
+}
+
+FVector APacificator::GetNextLookPoint()
+{
+	if (LookPoints.Num() == 0)
+		BuildLookPoints();
+
+	const FVector& LookPoint = LookPoints[NextLookPoint];
+	NextLookPoint = (NextLookPoint + 1) % LookPoints.Num();
+	return LookPoint;
+}
+
+void APacificator::SetTickTier(EPacificatorTickTier NewTier)
+{
+	if (TickTier == NewTier)
+		return;
+
+	TickTier = NewTier;
+
+	SetActorTickEnabled(TickTier != EPacificatorTickTier::Dormant);
+	SetActorTickInterval(TickTier == EPacificatorTickTier::Reduced ? UPacificatorSubsystem::GetReducedTickInterval() : 0.f);
+
+	if (APacificatorAIController* PacificatorController = Cast<APacificatorAIController>(GetController()))
+		PacificatorController->SetTickTier(TickTier);
+}
+
+void APacificator::SetEnemySpotted(bool bSpotted)
+{
+	if (bEnemySpotted == bSpotted)
+		return;
+
+	bEnemySpotted = bSpotted;
+	UpdateLight();
+}
+
+void APacificator::OnRep_EnemySpotted()
+{
+	UpdateLight();
+}
+
+void APacificator::UpdateLight()
+{
+	if (!FApp::CanEverRender())
+		return;
+
+	UPacificatorVisualsSubsystem* Visuals = GetWorld()->GetSubsystem<UPacificatorVisualsSubsystem>();
+	if (Visuals && LightInstance.IsValid())
+	{
+		Visuals->UpdateInstance(LightInstance, Light, GetLightMaterial(bEnemySpotted), bEnemySpotted ? 1.f : 0.f);
+		return;
+	}
+
+	// Both looks are plain shared materials, nothing is allocated per turret
+	if (UMaterialInterface* Material = GetLightMaterial(bEnemySpotted))
+		Light->SetMaterial(0, Material);
+}
+
+void APacificator::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME(APacificator, bEnemySpotted);
+}
+
+UMaterialInterface* APacificator::GetLightMaterial(bool bSpotted) const
+{
+	if (InstancedLightMaterial)
+		return InstancedLightMaterial;
+
+	return bSpotted ? EnemySpottedMaterial.Get() : NeutralMaterial.Get();
+}
+
+void APacificator::LoadLightMaterials()
+{
+	TArray<FSoftObjectPath> Pending;
+	for (const TSoftObjectPtr<UMaterialInterface>* Material : { &NeutralMaterial, &EnemySpottedMaterial })
+	{
+		if (Material->IsNull())
+			UE_LOG(LogRunFromCamera, Warning, TEXT("%s has no light material set, the light keeps its mesh material"), *GetName());
+		else if (Material->IsPending())
+			Pending.Add(Material->ToSoftObjectPath());
+	}
+
+	if (Pending.Num() == 0)
+		return;
+
+	// Normally the preload bundle got here first, this only covers turrets spawned before it finished
+	TWeakObjectPtr<APacificator> WeakThis(this);
+	UAssetManager::GetStreamableManager().RequestAsyncLoad(Pending, [WeakThis, Pending]()
+	{
+		for (const FSoftObjectPath& Path : Pending)
+		{
+			if (!Path.ResolveObject())
+				UE_LOG(LogRunFromCamera, Error, TEXT("Could not load Pacificator light material %s"), *Path.ToString());
+		}
+
+		if (APacificator* Pacificator = WeakThis.Get())
+			Pacificator->UpdateLight();
+	});
+}
+
+void APacificator::GetPreloadAssets(TSubclassOf<APacificator> PacificatorClass, TArray<FSoftObjectPath>& OutAssets)
+{
+	if (!PacificatorClass || !FApp::CanEverRender())
+		return;
+
+	// The Blueprint's defaults, the materials are usually overridden there
+	const APacificator* Defaults = PacificatorClass->GetDefaultObject<APacificator>();
+	for (const TSoftObjectPtr<UMaterialInterface>* Material : { &Defaults->NeutralMaterial, &Defaults->EnemySpottedMaterial })
+	{
+		if (!Material->IsNull())
+			OutAssets.AddUnique(Material->ToSoftObjectPath());
+	}
+}
+
+void APacificator::RegisterInstancedVisuals()
+{
+	UPacificatorVisualsSubsystem* Visuals = GetWorld()->GetSubsystem<UPacificatorVisualsSubsystem>();
+	if (!Visuals || !Visuals->IsEnabled())
+		return;
+
+	// The components stay for collision and for the muzzle, hidden ones never get a render proxy
+	// Light and lens are the head and barrel the controller turns, the box is the base
+	LightInstance = Visuals->AddInstance(Light, GetLightMaterial(bEnemySpotted), bEnemySpotted ? 1.f : 0.f);
+	BoxInstance = Visuals->AddInstance(Box, nullptr, 0.f, false);
+	LensInstance = Visuals->AddInstance(Lens);
+
+	Light->SetVisibility(!LightInstance.IsValid());
+	Box->SetVisibility(!BoxInstance.IsValid());
+	Lens->SetVisibility(!LensInstance.IsValid());
+
+	RootComponent->TransformUpdated.AddUObject(this, &APacificator::OnRootTransformUpdated);
+}
+
+void APacificator::UnregisterInstancedVisuals()
+{
+	UPacificatorVisualsSubsystem* Visuals = GetWorld()->GetSubsystem<UPacificatorVisualsSubsystem>();
+	if (!Visuals)
+		return;
+
+	RootComponent->TransformUpdated.RemoveAll(this);
+
+	Visuals->RemoveInstance(LightInstance);
+	Visuals->RemoveInstance(BoxInstance);
+	Visuals->RemoveInstance(LensInstance);
+}
+
+void APacificator::OnRootTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport)
+{
+	UPacificatorVisualsSubsystem* Visuals = GetWorld()->GetSubsystem<UPacificatorVisualsSubsystem>();
+	if (!Visuals)
+		return;
+
+	// Children are only moved after this broadcast, their world transforms are still the old ones
+	const FTransform& RootTransform = UpdatedComponent->GetComponentTransform();
+	Visuals->UpdateInstanceTransform(LightInstance, Light->GetRelativeTransform() * RootTransform);
+	Visuals->UpdateInstanceTransform(BoxInstance, Box->GetRelativeTransform() * RootTransform);
+	Visuals->UpdateInstanceTransform(LensInstance, Lens->GetRelativeTransform() * RootTransform);
+}
+
+bool APacificator::IsWeaponReady() const
+{
+	const UWorld* World = GetWorld();
+	return World && World->GetTimeSeconds() >= NextFireTime;
+}
+
 void APacificator::Fire()
 {
-	if (ProjectileClass && bCanShoot)
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_PacificatorFire);
+
+	if (ProjectileClass && IsWeaponReady())
 	{
 		UWorld* World = GetWorld();
 		if (World)
 		{
-			bCanShoot = false;
-			GetWorldTimerManager().SetTimer(WeaponCooldown, this, &APacificator::CanShoot, WeaponFireRate, true);
-			FActorSpawnParameters SpawnParams;
-			SpawnParams.Owner = this;
-			SpawnParams.Instigator = GetInstigator();
-
-			// Spawn the projectile at the muzzle.
-			AProjectile* Projectile = World->SpawnActor<AProjectile>(ProjectileClass, MuzzlePoint->GetComponentLocation(), MuzzlePoint->GetComponentRotation(), SpawnParams);
-			
-			// Since the projectile is owned by the camera we are looking to find the main character pawn
-			Projectile->CollisionComponent->BodyInstance.SetCollisionProfileName(TEXT("Pawn"));
-			if (Projectile)
+			NextFireTime = World->GetTimeSeconds() + WeaponFireRate / UPacificatorSubsystem::GetFireRateScale();
+			const FVector MuzzleLocation = MuzzlePoint->GetComponentLocation();
+			const FRotator MuzzleRotation = MuzzlePoint->GetComponentRotation();
+			FVector LaunchDirection = MuzzleRotation.Vector();
+
+			// Turret bullets never need an actor of their own, let the projectile manager fly them
+			UProjectileManagerSubsystem* ProjectileManager = World->GetSubsystem<UProjectileManagerSubsystem>();
+			if (ProjectileManager && ProjectileManager->IsSimulationEnabled())
+			{
+				ProjectileManager->Launch(ProjectileClass, MuzzleLocation, LaunchDirection, ProjectilePreset, this);
+			}
+			else if (UProjectilePoolSubsystem* Pool = World->GetSubsystem<UProjectilePoolSubsystem>())
+			{
+				// Take a projectile from the pool and place it at the muzzle. The preset already carries the "TurretProjectile" profile.
+				AProjectile* Projectile = Pool->Acquire(ProjectileClass, MuzzleLocation, MuzzleRotation, ProjectilePreset, this, GetInstigator());
+				if (Projectile)
+				{
+					Projectile->FireInDirection(LaunchDirection);
+				}
+			}
+
+			if (ProjectileManager)
 			{
-				FVector LaunchDirection = MuzzlePoint->GetComponentRotation().Vector();
-				Projectile->FireInDirection(LaunchDirection);
+				ProjectileManager->RecordShot();
+
+				if (GetNetMode() != NM_Standalone)
+				{
+					const FProjectileFireEvent FireEvent = ProjectileManager->MakeFireEvent(MuzzleLocation, LaunchDirection, 0);
+					ProjectileManager->RecordFireEventSent(FireEvent);
+					MulticastFire(FireEvent);
+				}
 			}
 		}
 	}
 }
 
+void APacificator::MulticastFire_Implementation(const FProjectileFireEvent& FireEvent)
+{
+	if (HasAuthority())
+		return;
+
+	if (UProjectileManagerSubsystem* ProjectileManager = GetWorld()->GetSubsystem<UProjectileManagerSubsystem>())
+		ProjectileManager->LaunchFromFireEvent(ProjectileClass, FireEvent, ProjectilePreset, this);
+}
+
 // Called to bind functionality to input
 void APacificator::SetupPlayerInputComponent(UInputComponent* PlayerInputComponent)
 {
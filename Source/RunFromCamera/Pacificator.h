@@ -5,13 +5,67 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Pawn.h"
 #include "Components/ArrowComponent.h"
+#include "ProjectilePoolSubsystem.h"
+#include "PacificatorSubsystem.h"
+#include "PacificatorVisualsSubsystem.h"
+#include "ProjectileManagerSubsystem.h"
 #include "Pacificator.generated.h"
 
+/**
+ * How far and how wide a single turret sees, used by the Pacificator subsystem's sight pass.
+ */
+USTRUCT(BlueprintType)
+struct FPacificatorSightConfig
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sight")
+	float SightRadius = 3000.f;
+
+	// Once the player is seen it stays seen up to this distance
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sight")
+	float LoseSightRadius = 3500.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Sight", meta = (ClampMin = "0.0", ClampMax = "180.0"))
+	float PeripheralVisionHalfAngleDegrees = 60.f;
+};
+
+/**
+ * Where a turret looks around while it searches for the player. Look points are spread over a ring sector
+ * in front of the turret as it was placed.
+ */
+USTRUCT(BlueprintType)
+struct FPacificatorSearchConfig
+{
+	GENERATED_BODY()
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Search")
+	float MinLookDistance = 500.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Search")
+	float MaxLookDistance = 1600.f;
+
+	// 180 looks all the way around
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Search", meta = (ClampMin = "0.0", ClampMax = "180.0"))
+	float LookArcHalfAngleDegrees = 180.f;
+
+	// Look points go up or down by at most this much from the turret's height
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Search")
+	float MaxLookHeightOffset = 50.f;
+
+	// Size of the precomputed set, the turret cycles through it
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Search", meta = (ClampMin = "1"))
+	int32 NumLookPoints = 16;
+};
+
 UCLASS()
 class RUNFROMCAMERA_API APacificator : public APawn
 {
 	GENERATED_BODY()
 
+	// Copies the turret's state in and out when it moves between actor and turret field
+	friend class UPacificatorFieldSubsystem;
+
 public:
 	// Sets default values for this pawn's properties
 	APacificator();
@@ -20,6 +74,8 @@ protected:
 	// Called when the game starts or when spawned
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 public:	
 	// Called every frame
 	virtual void Tick(float DeltaTime) override;
@@ -29,7 +85,29 @@ public:
 	// Called to bind functionality to input
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 
-	void CanShoot() { bCanShoot = true; }
+	// True once WeaponFireRate, scaled by RunFromCamera.TurretFire.RateScale, has passed since the last shot
+	bool IsWeaponReady() const;
+
+	// Applies a significance tier to the turret and its controller
+	void SetTickTier(EPacificatorTickTier NewTier);
+
+	EPacificatorTickTier GetTickTier() const { return TickTier; }
+
+	// Switches the light between the neutral and the enemy spotted look
+	void SetEnemySpotted(bool bSpotted);
+
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
+	// Light materials of PacificatorClass's defaults, streamed in by the game mode while the map loads
+	static void GetPreloadAssets(TSubclassOf<APacificator> PacificatorClass, TArray<FSoftObjectPath>& OutAssets);
+
+	const FPacificatorSightConfig& GetSightConfig() const { return SightConfig; }
+
+	// Next point of the precomputed search pattern, used by the random look point task
+	FVector GetNextLookPoint();
+
+	// Where sight traces start from
+	FVector GetSightLocation() const { return MuzzlePoint->GetComponentLocation(); }
 
 	UPROPERTY(VisibleAnywhere, BlueprintReadWrite)
 	UStaticMeshComponent* Light;
@@ -40,30 +118,86 @@ public:
 	UPROPERTY(VisibleAnywhere, BlueprintReadWrite)
 	UStaticMeshComponent* Lens;
 
-	UPROPERTY(VisibleDefaultsOnly, Category = "Pacificator | Material")
-	UMaterialInstanceDynamic* NeutralMaterialInstance;
+private:
+	// Turrets only fire on the server, clients fly the bullet from this
+	UFUNCTION(NetMulticast, Unreliable)
+	void MulticastFire(const FProjectileFireEvent& FireEvent);
 
-	UPROPERTY(VisibleDefaultsOnly, Category = "Pacificator | Material")
-	UMaterialInstanceDynamic* EnemyMaterialInstance;
+	UFUNCTION()
+	void OnRep_EnemySpotted();
 
-private:
-	UPROPERTY(VisibleDefaultsOnly, Category = "Pacificator | Material")
-	UMaterial* EnemySpottedMaterial;
+	void UpdateLight();
+
+	// Null while the soft materials are still streaming in
+	UMaterialInterface* GetLightMaterial(bool bSpotted) const;
+
+	// Requests whichever light material isn't in memory yet and refreshes the light once it is
+	void LoadLightMaterials();
+
+	// Hands the meshes over to the visuals subsystem and stops drawing the components themselves
+	void RegisterInstancedVisuals();
+
+	void UnregisterInstancedVisuals();
+
+	// Fills LookPoints from a Halton sequence, evenly covering the search arc without clumping like random points do
+	void BuildLookPoints();
+
+	// Keeps the instances following the turret as the controller turns it
+	void OnRootTransformUpdated(USceneComponent* UpdatedComponent, EUpdateTransformFlags UpdateTransformFlags, ETeleportType Teleport);
+
+	UPROPERTY(EditDefaultsOnly, Category = "Pacificator | Material")
+	TSoftObjectPtr<UMaterialInterface> EnemySpottedMaterial;
 
-	UPROPERTY(VisibleDefaultsOnly, Category = "Pacificator | Material")
-	UMaterialInstance* NeutralMaterial;
+	UPROPERTY(EditDefaultsOnly, Category = "Pacificator | Material")
+	TSoftObjectPtr<UMaterialInterface> NeutralMaterial;
+
+	// Light material for instanced turrets that switches look on PerInstanceCustomData[0] (0 neutral, 1 enemy spotted).
+	// Without it a spotted turret's light is moved between the neutral and enemy spotted instance buckets.
+	UPROPERTY(EditDefaultsOnly, Category = "Pacificator | Material")
+	UMaterialInterface* InstancedLightMaterial = nullptr;
+
+	FPacificatorInstanceHandle LightInstance;
+
+	FPacificatorInstanceHandle BoxInstance;
+
+	FPacificatorInstanceHandle LensInstance;
 
 	UPROPERTY(VisibleAnywhere, Category = "Pacificator | Shooting")
 	UArrowComponent* MuzzlePoint;
 
+	UPROPERTY(EditAnywhere, Category = "Pacificator | Sight")
+	FPacificatorSightConfig SightConfig;
+
+	UPROPERTY(EditAnywhere, Category = "Pacificator | Sight")
+	FPacificatorSearchConfig SearchConfig;
+
+	// Far from the player the turret is run by the turret field without an actor or controller, and spawned
+	// again once the player comes close. Single player only, and only while searching.
+	UPROPERTY(EditAnywhere, Category = "Pacificator | Field")
+	bool bUseTurretField = false;
+
 	UPROPERTY(EditDefaultsOnly, Category = "Pacificator | Shooting")
 	TSubclassOf<class AProjectile> ProjectileClass;
 
+	// TurretProjectile blocks pawns so it finds the main character, and ignores the other turrets' bullets
 	UPROPERTY(EditDefaultsOnly, Category = "Pacificator | Shooting")
-	FTimerHandle WeaponCooldown;
+	FProjectilePreset ProjectilePreset;
 
+	// Seconds between two shots
 	UPROPERTY(EditDefaultsOnly, Category = "Pacificator | Shooting")
 	float WeaponFireRate;
 
-	bool bCanShoot;
+	// World time the weapon can fire again. A time stamp instead of a timer, nothing has to run when it expires.
+	double NextFireTime = 0.0;
+
+	// Controllers only exist on the server, clients learn about the light from this
+	UPROPERTY(ReplicatedUsing = OnRep_EnemySpotted)
+	bool bEnemySpotted = false;
+
+	EPacificatorTickTier TickTier = EPacificatorTickTier::Full;
+
+	// World space, turrets never leave the spot they were placed on
+	TArray<FVector> LookPoints;
+
+	int32 NextLookPoint = 0;
 };
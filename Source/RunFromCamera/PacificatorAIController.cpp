@@ -1,45 +1,218 @@
 // Fill out your copyright notice in the Description page of Project Settings.
 
 #include "PacificatorAIController.h"
+#include "BehaviorTree/BehaviorTree.h"
 #include "BehaviorTree/BlackboardComponent.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Bool.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Object.h"
+#include "BehaviorTree/Blackboard/BlackboardKeyType_Vector.h"
 #include "Pacificator.h"
+#include "RunFromCamera.h"
 #include "Kismet/KismetMathLibrary.h"
+#include "Perception/AIPerceptionComponent.h"
+#include "Perception/AISense_Sight.h"
+
+DECLARE_CYCLE_STAT(TEXT("Pacificator Controller Tick"), STAT_PacificatorControllerTick, STATGROUP_RunFromCamera);
 
 APacificatorAIController::APacificatorAIController()
 {
 	PrimaryActorTick.bCanEverTick = true;
+
+	// Woken up by the first blackboard notification
+	PrimaryActorTick.bStartWithTickEnabled = false;
 }
 
-void APacificatorAIController::Tick(float DeltaTime)
+bool APacificatorAIController::InitializeBlackboard(UBlackboardComponent& BlackboardComp, UBlackboardData& BlackboardAsset)
+{
+	if ( !Super::InitializeBlackboard(BlackboardComp, BlackboardAsset) )
+		return false;
+
+	// Resolve the key names once, the hot path only ever sees cached values
+	EnemyInSightKeyID = BlackboardAsset.GetKeyID("bEnemyInSight");
+	EnemyKeyID = BlackboardAsset.GetKeyID("Enemy");
+	EnemyPositionKeyID = BlackboardAsset.GetKeyID("EnemyPosition");
+	RandomPositionKeyID = BlackboardAsset.GetKeyID("RandomPosition");
+
+	for ( FBlackboard::FKey KeyID : { EnemyInSightKeyID, EnemyPositionKeyID, RandomPositionKeyID } )
+	{
+		if ( KeyID != FBlackboard::InvalidKey )
+			BlackboardComp.RegisterObserver(KeyID, this, FOnBlackboardChangeNotification::CreateUObject(this, &APacificatorAIController::OnBlackboardKeyChanged));
+	}
+
+	bEnemyInSight = BlackboardComp.GetValue<UBlackboardKeyType_Bool>(EnemyInSightKeyID);
+	EnemyPosition = BlackboardComp.GetValue<UBlackboardKeyType_Vector>(EnemyPositionKeyID);
+	RandomPosition = BlackboardComp.GetValue<UBlackboardKeyType_Vector>(RandomPositionKeyID);
+	bIsRotating = true;
+
+	EnterState(bEnemyInSight ? EPacificatorState::Engaged : EPacificatorState::Searching);
+	return true;
+}
+
+bool APacificatorAIController::RunBehaviorTree(UBehaviorTree* BTAsset)
+{
+	UPacificatorSubsystem* PacificatorSubsystem = GetWorld()->GetSubsystem<UPacificatorSubsystem>();
+	if ( BTAsset && BTAsset->BlackboardAsset && PacificatorSubsystem && UPacificatorSubsystem::IsNativeBehaviorTreeEnabled() )
+		return Super::RunBehaviorTree(PacificatorSubsystem->GetNativeBehaviorTree(BTAsset->BlackboardAsset));
+
+	return Super::RunBehaviorTree(BTAsset);
+}
+
+void APacificatorAIController::BeginPlay()
 {
-	Blackboard = GetBlackboardComponent();
+	Super::BeginPlay();
+
+	// The Pacificator subsystem only tests turrets near the player, perception would test all of them
+	if ( UPacificatorSubsystem::IsNativeSightEnabled() )
+	{
+		UAIPerceptionComponent* Perception = GetPerceptionComponent() ? GetPerceptionComponent() : FindComponentByClass<UAIPerceptionComponent>();
+		if ( Perception )
+			Perception->SetSenseEnabled(UAISense_Sight::StaticClass(), false);
+	}
+}
 
+void APacificatorAIController::SetSightedEnemy(AActor* Enemy)
+{
+	if ( !Blackboard )
+		return;
+
+	// Enemy first, so anything observing the sight flag can already read who was seen
+	if ( Enemy && EnemyKeyID != FBlackboard::InvalidKey )
+		Blackboard->SetValue<UBlackboardKeyType_Object>(EnemyKeyID, Enemy);
+
+	if ( EnemyInSightKeyID != FBlackboard::InvalidKey )
+		Blackboard->SetValue<UBlackboardKeyType_Bool>(EnemyInSightKeyID, Enemy != nullptr);
+}
+
+void APacificatorAIController::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
 	if ( Blackboard )
+		Blackboard->UnregisterObserversFrom(this);
+
+	SetCountedAsEngaged(false);
+
+	Super::EndPlay(EndPlayReason);
+}
+
+EBlackboardNotificationResult APacificatorAIController::OnBlackboardKeyChanged(const UBlackboardComponent& BlackboardComp, FBlackboard::FKey ChangedKeyID)
+{
+	if ( ChangedKeyID == EnemyInSightKeyID )
 	{
-		bool bIsEnemyInSight = Blackboard->GetValueAsBool("bEnemyInSight");
-		auto ControlledPawn = AController::GetPawn();
-		APacificator* PacificatorCamera = Cast<APacificator>(ControlledPawn);
-		if ( bIsEnemyInSight && PacificatorCamera )
+		const bool bNewEnemyInSight = BlackboardComp.GetValue<UBlackboardKeyType_Bool>(ChangedKeyID);
+		if ( bNewEnemyInSight != bEnemyInSight )
 		{
-			auto Target = UKismetMathLibrary::FindLookAtRotation(PacificatorCamera->GetActorLocation(), Blackboard->GetValueAsVector("EnemyPosition"));
-			PacificatorCamera->SetActorRotation(FMath::RInterpTo(PacificatorCamera->GetActorRotation(), Target, DeltaTime, CameraTurnRate));
-			
-			if (PacificatorCamera->Light->GetMaterial(0) != PacificatorCamera->EnemyMaterialInstance)
-				PacificatorCamera->Light->SetMaterial(0, PacificatorCamera->EnemyMaterialInstance);
-			
-			PacificatorCamera->Fire();
+			bEnemyInSight = bNewEnemyInSight;
+			OnEnemySightChanged.Broadcast(bEnemyInSight);
+			EnterState(bEnemyInSight ? EPacificatorState::Engaged : EPacificatorState::Searching);
 		}
-		else if ( !bIsEnemyInSight && PacificatorCamera )
+	}
+	else if ( ChangedKeyID == EnemyPositionKeyID )
+	{
+		EnemyPosition = BlackboardComp.GetValue<UBlackboardKeyType_Vector>(ChangedKeyID);
+		if ( State == EPacificatorState::Engaged )
+			OnTargetChanged.Broadcast(EnemyPosition);
+	}
+	else if ( ChangedKeyID == RandomPositionKeyID )
+	{
+		RandomPosition = BlackboardComp.GetValue<UBlackboardKeyType_Vector>(ChangedKeyID);
+		if ( State == EPacificatorState::Searching )
 		{
-			auto Target = UKismetMathLibrary::FindLookAtRotation(PacificatorCamera->GetActorLocation(), Blackboard->GetValueAsVector("RandomPosition"));
-			//Get random value for camera rotation for more sudden movements when in "search mode"
-			PacificatorCamera->SetActorRotation(FMath::RInterpTo(PacificatorCamera->GetActorRotation(), Target, DeltaTime, FMath::FRandRange(0.5f, CameraTurnRate)));
+			SearchTurnRate = FMath::FRandRange(0.5f, CameraTurnRate);
+			bIsRotating = true;
+			UpdateTickState();
+			OnTargetChanged.Broadcast(RandomPosition);
+		}
+	}
 
-			if ( PacificatorCamera->Light->GetMaterial(0) != PacificatorCamera->NeutralMaterialInstance )
-				PacificatorCamera->Light->SetMaterial(0, PacificatorCamera->NeutralMaterialInstance);
+	return EBlackboardNotificationResult::ContinueObserving;
+}
+
+void APacificatorAIController::EnterState(EPacificatorState NewState)
+{
+	State = NewState;
+
+	// Turn towards whatever the new state looks at, searching turrets go idle again once they get there
+	bIsRotating = true;
+
+	if ( APacificator* PacificatorCamera = Cast<APacificator>(GetPawn()) )
+		PacificatorCamera->SetEnemySpotted(State == EPacificatorState::Engaged);
+
+	SetCountedAsEngaged(State == EPacificatorState::Engaged);
+	UpdateTickState();
+}
+
+void APacificatorAIController::SetCountedAsEngaged(bool bEngaged)
+{
+	if ( bEngaged == bCountedAsEngaged )
+		return;
+
+	bCountedAsEngaged = bEngaged;
+	if ( UPacificatorSubsystem* PacificatorSubsystem = GetWorld()->GetSubsystem<UPacificatorSubsystem>() )
+		PacificatorSubsystem->NotifyEngagedChanged(bEngaged);
+}
+
+void APacificatorAIController::SetTickTier(EPacificatorTickTier NewTier)
+{
+	TickTier = NewTier;
+	SetActorTickInterval(TickTier == EPacificatorTickTier::Reduced ? UPacificatorSubsystem::GetReducedTickInterval() : 0.f);
+
+	// Don't try to catch up on the time spent asleep
+	if ( TickTier == EPacificatorTickTier::Dormant )
+		LastRotationUpdateTime = -1.0;
+
+	UpdateTickState();
+}
+
+void APacificatorAIController::UpdateTickState()
+{
+	const bool bHasWork = State == EPacificatorState::Engaged || bIsRotating;
+	const bool bShouldTick = bHasWork && TickTier != EPacificatorTickTier::Dormant;
+
+	if ( bShouldTick != IsActorTickEnabled() )
+	{
+		// Resuming after an idle stretch must not count the idle time as rotation time
+		if ( bShouldTick )
+			LastRotationUpdateTime = -1.0;
+
+		SetActorTickEnabled(bShouldTick);
+	}
+}
+
+FRotator APacificatorAIController::InterpRotation(const FRotator& Current, const FRotator& Target, float InterpSpeed)
+{
+	const double Now = GetWorld()->GetTimeSeconds();
+	const float ElapsedTime = LastRotationUpdateTime < 0.0 ? GetWorld()->GetDeltaSeconds() : FMath::Min(static_cast<float>(Now - LastRotationUpdateTime), MaxRotationDeltaTime);
+	LastRotationUpdateTime = Now;
+
+	// One RInterpTo step covers Speed * DeltaTime of the remaining angle. Over a long tick the turret has to cover
+	// what all the skipped frames would have compounded to, which is 1 - e^(-Speed * ElapsedTime).
+	const float Alpha = 1.f - FMath::Exp(-InterpSpeed * ElapsedTime);
+	return FMath::RInterpTo(Current, Target, 1.f, Alpha);
+}
+
+void APacificatorAIController::Tick(float DeltaTime)
+{
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_PacificatorControllerTick);
+
+	APacificator* PacificatorCamera = Cast<APacificator>(GetPawn());
+	if ( PacificatorCamera )
+	{
+		const bool bEngaged = State == EPacificatorState::Engaged;
+		const FVector& TargetPosition = bEngaged ? EnemyPosition : RandomPosition;
+
+		auto Target = UKismetMathLibrary::FindLookAtRotation(PacificatorCamera->GetActorLocation(), TargetPosition);
+		const FRotator NewRotation = InterpRotation(PacificatorCamera->GetActorRotation(), Target, bEngaged ? CameraTurnRate : SearchTurnRate);
+		PacificatorCamera->SetActorRotation(NewRotation);
+
+		if ( bEngaged )
+		{
+			PacificatorCamera->Fire();
+		}
+		else if ( NewRotation.Equals(Target, SettledRotationTolerance) )
+		{
+			bIsRotating = false;
+			UpdateTickState();
 		}
 	}
 
 	Super::Tick(DeltaTime);
 }
-
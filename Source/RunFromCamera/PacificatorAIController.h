@@ -5,10 +5,26 @@
 #include "CoreMinimal.h"
 #include "AIController.h"
 #include <BehaviorTree/BehaviorTreeTypes.h>
+#include "PacificatorSubsystem.h"
 #include "PacificatorAIController.generated.h"
 
+UENUM(BlueprintType)
+enum class EPacificatorState : uint8
+{
+	Searching = 0	UMETA(DisplayName = "Searching"),
+	Engaged = 1		UMETA(DisplayName = "Engaged")
+};
+
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnPacificatorSightChanged, bool /*bEnemyInSight*/);
+DECLARE_MULTICAST_DELEGATE_OneParam(FOnPacificatorTargetChanged, const FVector& /*TargetPosition*/);
+
 /**
- * 
+ * Drives a Pacificator from blackboard change notifications instead of polling the blackboard every frame.
+ * Sight changes move the controller between Searching and Engaged, and it only ticks while the turret is
+ * engaged or still turning towards its current look point.
+ *
+ * The tree the Blueprint controller starts is swapped for one built from the native look point task and enemy
+ * position service, on the same blackboard.
  */
 UCLASS()
 class RUNFROMCAMERA_API APacificatorAIController : public AAIController
@@ -24,6 +40,79 @@ public:
 	UPROPERTY(EditAnywhere)
 	FBlackboardKeySelector BlackboardKey;
 
+	virtual bool InitializeBlackboard(UBlackboardComponent& BlackboardComp, UBlackboardData& BlackboardAsset) override;
+
+	// Runs the Pacificator subsystem's native tree in place of the requested one when RunFromCamera.TurretAI.NativeTree is on
+	virtual bool RunBehaviorTree(UBehaviorTree* BTAsset) override;
+
+	bool IsEnemyInSight() const { return bEnemyInSight; }
+
+	// Writes a sight result from the Pacificator subsystem into the blackboard, null when the enemy was lost
+	void SetSightedEnemy(AActor* Enemy);
+
+	EPacificatorState GetState() const { return State; }
+
+	// Called by the controlled Pacificator when the significance manager moves it to another tier
+	void SetTickTier(EPacificatorTickTier NewTier);
+
+	// Broadcast when the perception result stored in the blackboard flips
+	FOnPacificatorSightChanged OnEnemySightChanged;
+
+	// Broadcast when the point the turret turns towards moves, either the enemy or the next random look point
+	FOnPacificatorTargetChanged OnTargetChanged;
+
+protected:
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 private:
+	EBlackboardNotificationResult OnBlackboardKeyChanged(const UBlackboardComponent& BlackboardComp, FBlackboard::FKey ChangedKeyID);
+
+	void EnterState(EPacificatorState NewState);
+
+	// Ticks only while there is work to do and the significance tier allows it
+	void UpdateTickState();
+
+	// Keeps the engaged turret count of the Pacificator subsystem in step with our state
+	void SetCountedAsEngaged(bool bEngaged);
+
+	// RInterpTo compensated for the time since the last rotation update, so turrets ticking at a reduced
+	// rate still sweep at the same angular speed as full rate ones
+	FRotator InterpRotation(const FRotator& Current, const FRotator& Target, float InterpSpeed);
+
 	float CameraTurnRate = 3.0f;
+
+	// Longest gap the rotation catches up on in one go, e.g. after waking up from the dormant tier
+	float MaxRotationDeltaTime = 0.5f;
+
+	double LastRotationUpdateTime = -1.0;
+
+	// Degrees from the look point at which a searching turret stops turning and goes idle
+	float SettledRotationTolerance = 0.5f;
+
+	EPacificatorState State = EPacificatorState::Searching;
+
+	EPacificatorTickTier TickTier = EPacificatorTickTier::Full;
+
+	FBlackboard::FKey EnemyInSightKeyID = FBlackboard::InvalidKey;
+
+	FBlackboard::FKey EnemyKeyID = FBlackboard::InvalidKey;
+
+	FBlackboard::FKey EnemyPositionKeyID = FBlackboard::InvalidKey;
+
+	FBlackboard::FKey RandomPositionKeyID = FBlackboard::InvalidKey;
+
+	bool bEnemyInSight = false;
+
+	bool bIsRotating = false;
+
+	bool bCountedAsEngaged = false;
+
+	FVector EnemyPosition = FVector::ZeroVector;
+
+	FVector RandomPosition = FVector::ZeroVector;
+
+	// Picked once per look point for more sudden movements when in "search mode"
+	float SearchTurnRate = 3.0f;
 };
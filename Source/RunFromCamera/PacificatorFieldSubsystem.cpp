@@ -0,0 +1,448 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PacificatorFieldSubsystem.h"
+#include "RunFromCamera.h"
+#include "Pacificator.h"
+#include "PacificatorAIController.h"
+#include "PacificatorSubsystem.h"
+#include "PacificatorVisualsSubsystem.h"
+#include "Async/ParallelFor.h"
+
+DECLARE_CYCLE_STAT(TEXT("Pacificator Field Aim"), STAT_PacificatorFieldAim, STATGROUP_RunFromCamera);
+DECLARE_CYCLE_STAT(TEXT("Pacificator Field Visuals"), STAT_PacificatorFieldVisuals, STATGROUP_RunFromCamera);
+DECLARE_CYCLE_STAT(TEXT("Pacificator Field Promotion"), STAT_PacificatorFieldPromotion, STATGROUP_RunFromCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pacificators In Field"), STAT_PacificatorsInField, STATGROUP_RunFromCamera);
+
+static TAutoConsoleVariable<bool> CVarPacificatorFieldEnabled(
+	TEXT("RunFromCamera.TurretField.Enabled"),
+	true,
+	TEXT("Run opted in turrets far from the player without an actor. Turrets already in the field stay there until the player comes close."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPacificatorFieldPromoteDistance(
+	TEXT("RunFromCamera.TurretField.PromoteDistance"),
+	8000.f,
+	TEXT("Field turrets closer than this to the player become actors again. Never less than the largest sight radius plus a margin."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPacificatorFieldDemoteScale(
+	TEXT("RunFromCamera.TurretField.DemoteScale"),
+	1.25f,
+	TEXT("Turrets go into the field beyond PromoteDistance times this, so one walking along the border doesn't flip every update."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPacificatorFieldPromotionInterval(
+	TEXT("RunFromCamera.TurretField.PromotionInterval"),
+	0.25f,
+	TEXT("Seconds between two passes looking for turrets to move into or out of the field."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPacificatorFieldAimInterval(
+	TEXT("RunFromCamera.TurretField.AimInterval"),
+	0.1f,
+	TEXT("Seconds between two aim passes over the field. Nobody watches these turrets closely, 10 updates a second is plenty."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPacificatorFieldTurnRate(
+	TEXT("RunFromCamera.TurretField.TurnRate"),
+	3.f,
+	TEXT("Interp speed of field turrets turning towards their look point, the same as a searching controller's."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPacificatorFieldLookInterval(
+	TEXT("RunFromCamera.TurretField.LookInterval"),
+	3.f,
+	TEXT("Average seconds a field turret spends on one look point before it picks the next."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarPacificatorFieldParallelAim(
+	TEXT("RunFromCamera.TurretField.ParallelAim"),
+	true,
+	TEXT("Run the field aim pass on worker threads."),
+	ECVF_Default);
+
+namespace
+{
+	// Turrets handed to one worker at a time, small enough to spread 10k turrets over every core
+	constexpr int32 AimBatchSize = 512;
+
+	// Degrees a field turret has to turn before its instances are moved
+	constexpr float MinVisibleTurn = 0.05f;
+
+	// Margin over the largest sight radius, a promoted turret gets a few updates before it can see the player
+	constexpr float SightMargin = 1000.f;
+}
+
+void UPacificatorFieldSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	PacificatorSubsystem = Collection.InitializeDependency<UPacificatorSubsystem>();
+	Visuals = Collection.InitializeDependency<UPacificatorVisualsSubsystem>();
+}
+
+void UPacificatorFieldSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_PacificatorsInField, Classes.Num());
+
+	// The instances go away with the visuals subsystem's components
+	Classes.Empty();
+	Locations.Empty();
+	Yaws.Empty();
+	Pitches.Empty();
+	TargetYaws.Empty();
+	TargetPitches.Empty();
+	NextLookTimes.Empty();
+	NextFireTimes.Empty();
+	RotationChanged.Empty();
+	Parts.Empty();
+	Overrides.Empty();
+	LookPoints.Empty();
+	LookPointOffsets.Empty();
+	LookPointCounts.Empty();
+	NextLookPoints.Empty();
+	TargetLocations.Empty();
+	NumStaleLookPoints = 0;
+	PacificatorSubsystem = nullptr;
+	Visuals = nullptr;
+
+	Super::Deinitialize();
+}
+
+TStatId UPacificatorFieldSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UPacificatorFieldSubsystem, STATGROUP_Tickables);
+}
+
+bool UPacificatorFieldSubsystem::DoesSupportWorldType(EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+bool UPacificatorFieldSubsystem::IsEnabled() const
+{
+	// Destroying a replicated turret would take it away from every client, the field is a single player feature
+	return CVarPacificatorFieldEnabled.GetValueOnGameThread() && GetWorld()->GetNetMode() == NM_Standalone;
+}
+
+float UPacificatorFieldSubsystem::GetPromoteDistance() const
+{
+	const float MaxSightRadius = PacificatorSubsystem ? PacificatorSubsystem->GetMaxSightRadius() : 0.f;
+	return FMath::Max(CVarPacificatorFieldPromoteDistance.GetValueOnGameThread(), MaxSightRadius + SightMargin);
+}
+
+void UPacificatorFieldSubsystem::NotifyPacificatorBeginPlay(APacificator* Pacificator)
+{
+	if (!IsEnabled())
+		return;
+
+	// Without a player there is nobody to be far away from, the first promotion pass sorts these out
+	GatherTargetLocations();
+	if (TargetLocations.Num() == 0)
+		return;
+
+	const float DemoteDistance = GetPromoteDistance() * FMath::Max(CVarPacificatorFieldDemoteScale.GetValueOnGameThread(), 1.f);
+	if (GetNearestTargetDistanceSquared(Pacificator->GetActorLocation()) > FMath::Square(DemoteDistance))
+		Demote(Pacificator);
+}
+
+void UPacificatorFieldSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (Classes.Num() > 0)
+	{
+		TimeSinceAimUpdate += DeltaTime;
+		if (TimeSinceAimUpdate >= CVarPacificatorFieldAimInterval.GetValueOnGameThread())
+		{
+			UpdateAim(TimeSinceAimUpdate);
+			UpdateVisuals();
+			TimeSinceAimUpdate = 0.f;
+		}
+	}
+
+	TimeSincePromotionUpdate += DeltaTime;
+	if (TimeSincePromotionUpdate < CVarPacificatorFieldPromotionInterval.GetValueOnGameThread())
+		return;
+
+	TimeSincePromotionUpdate = 0.f;
+
+	// Promotion still runs with the field switched off, so turning it off brings every turret back
+	GatherTargetLocations();
+	if (TargetLocations.Num() > 0)
+		UpdatePromotion();
+}
+
+void UPacificatorFieldSubsystem::GatherTargetLocations()
+{
+	TargetLocations.Reset();
+	if (!PacificatorSubsystem)
+		return;
+
+	for (const APawn* Target : PacificatorSubsystem->GetSightTargets())
+	{
+		if (IsValid(Target))
+			TargetLocations.Add(Target->GetActorLocation());
+	}
+}
+
+float UPacificatorFieldSubsystem::GetNearestTargetDistanceSquared(const FVector& Location) const
+{
+	float NearestDistanceSquared = MAX_flt;
+	for (const FVector& TargetLocation : TargetLocations)
+		NearestDistanceSquared = FMath::Min(NearestDistanceSquared, FVector::DistSquared(TargetLocation, Location));
+	return NearestDistanceSquared;
+}
+
+bool UPacificatorFieldSubsystem::CanDemote(const APacificator* Pacificator) const
+{
+	if (!IsValid(Pacificator) || !Pacificator->bUseTurretField || Pacificator->bEnemySpotted)
+		return false;
+
+	// A turret drawing its own components would vanish, it has to be on the instanced path first
+	if (FApp::CanEverRender() && !(Pacificator->LightInstance.IsValid() && Pacificator->BoxInstance.IsValid() && Pacificator->LensInstance.IsValid()))
+		return false;
+
+	const APacificatorAIController* PacificatorController = Cast<APacificatorAIController>(Pacificator->GetController());
+	return !PacificatorController || PacificatorController->GetState() == EPacificatorState::Searching;
+}
+
+bool UPacificatorFieldSubsystem::Demote(APacificator* Pacificator)
+{
+	if (!CanDemote(Pacificator))
+		return false;
+
+	Classes.Add(Pacificator->GetClass());
+	Locations.Add(Pacificator->GetActorLocation());
+
+	const FRotator Rotation = Pacificator->GetActorRotation();
+	Yaws.Add(Rotation.Yaw);
+	Pitches.Add(Rotation.Pitch);
+	TargetYaws.Add(Rotation.Yaw);
+	TargetPitches.Add(Rotation.Pitch);
+
+	// Staggered so a freshly demoted crowd doesn't pick its next look point on the same frame
+	const float LookInterval = FMath::Max(CVarPacificatorFieldLookInterval.GetValueOnGameThread(), 0.f);
+	NextLookTimes.Add(GetWorld()->GetTimeSeconds() + FMath::FRandRange(0.f, LookInterval));
+	NextFireTimes.Add(Pacificator->NextFireTime);
+	RotationChanged.Add(false);
+
+	// The instances are taken over as they are, the turret won't remove them when it is destroyed
+	FPacificatorFieldParts& TurretParts = Parts.AddDefaulted_GetRef();
+	TurretParts.LightInstance = Pacificator->LightInstance;
+	TurretParts.BoxInstance = Pacificator->BoxInstance;
+	TurretParts.LensInstance = Pacificator->LensInstance;
+	TurretParts.LightRelative = Pacificator->Light->GetRelativeTransform();
+	TurretParts.BoxRelative = Pacificator->Box->GetRelativeTransform();
+	TurretParts.LensRelative = Pacificator->Lens->GetRelativeTransform();
+	TurretParts.RootScale = Pacificator->GetActorScale3D();
+	Pacificator->LightInstance = FPacificatorInstanceHandle();
+	Pacificator->BoxInstance = FPacificatorInstanceHandle();
+	Pacificator->LensInstance = FPacificatorInstanceHandle();
+
+	// A promoted turret is spawned from its class, anything set on the placed instance has to be carried over
+	FPacificatorFieldOverrides& TurretOverrides = Overrides.AddDefaulted_GetRef();
+	TurretOverrides.SightConfig = Pacificator->SightConfig;
+	TurretOverrides.SearchConfig = Pacificator->SearchConfig;
+	TurretOverrides.bUseTurretField = Pacificator->bUseTurretField;
+	TurretOverrides.Tags = Pacificator->Tags;
+	TurretOverrides.AIControllerClass = Pacificator->AIControllerClass;
+
+	LookPointOffsets.Add(LookPoints.Num());
+	LookPointCounts.Add(Pacificator->LookPoints.Num());
+	NextLookPoints.Add(Pacificator->NextLookPoint);
+	LookPoints.Append(Pacificator->LookPoints);
+
+	if (AController* PacificatorController = Pacificator->GetController())
+		PacificatorController->Destroy();
+	Pacificator->Destroy();
+
+	INC_DWORD_STAT(STAT_PacificatorsInField);
+	return true;
+}
+
+void UPacificatorFieldSubsystem::Promote(int32 Index)
+{
+	UWorld* World = GetWorld();
+	const FTransform Transform(FRotator(Pitches[Index], Yaws[Index], 0.f), Locations[Index], Parts[Index].RootScale);
+
+	FPacificatorFieldParts& TurretParts = Parts[Index];
+	if (Visuals)
+	{
+		Visuals->RemoveInstance(TurretParts.LightInstance);
+		Visuals->RemoveInstance(TurretParts.BoxInstance);
+		Visuals->RemoveInstance(TurretParts.LensInstance);
+	}
+
+	// Deferred so the turret begins play with the state it had in the field
+	APacificator* Pacificator = World->SpawnActorDeferred<APacificator>(Classes[Index], Transform, nullptr, nullptr, ESpawnActorCollisionHandlingMethod::AlwaysSpawn);
+	if (Pacificator)
+	{
+		const FPacificatorFieldOverrides& TurretOverrides = Overrides[Index];
+		Pacificator->SightConfig = TurretOverrides.SightConfig;
+		Pacificator->SearchConfig = TurretOverrides.SearchConfig;
+		Pacificator->bUseTurretField = TurretOverrides.bUseTurretField;
+		Pacificator->Tags = TurretOverrides.Tags;
+		Pacificator->AIControllerClass = TurretOverrides.AIControllerClass;
+		Pacificator->NextFireTime = NextFireTimes[Index];
+		Pacificator->LookPoints = TArray<FVector>(LookPoints.GetData() + LookPointOffsets[Index], LookPointCounts[Index]);
+		Pacificator->NextLookPoint = NextLookPoints[Index];
+		Pacificator->FinishSpawning(Transform);
+
+		// Placed turrets were possessed when the level loaded, a spawned one only is if its class says so
+		if (!Pacificator->GetController())
+			Pacificator->SpawnDefaultController();
+	}
+	else
+	{
+		UE_LOG(LogRunFromCamera, Warning, TEXT("Pacificator field failed to spawn %s, the turret is lost"), *GetNameSafe(Classes[Index]));
+	}
+
+	RemoveAt(Index);
+}
+
+void UPacificatorFieldSubsystem::RemoveAt(int32 Index)
+{
+	NumStaleLookPoints += LookPointCounts[Index];
+
+	Classes.RemoveAtSwap(Index, 1, false);
+	Locations.RemoveAtSwap(Index, 1, false);
+	Yaws.RemoveAtSwap(Index, 1, false);
+	Pitches.RemoveAtSwap(Index, 1, false);
+	TargetYaws.RemoveAtSwap(Index, 1, false);
+	TargetPitches.RemoveAtSwap(Index, 1, false);
+	NextLookTimes.RemoveAtSwap(Index, 1, false);
+	NextFireTimes.RemoveAtSwap(Index, 1, false);
+	RotationChanged.RemoveAtSwap(Index, 1, false);
+	Parts.RemoveAtSwap(Index, 1, false);
+	Overrides.RemoveAtSwap(Index, 1, false);
+	LookPointOffsets.RemoveAtSwap(Index, 1, false);
+	LookPointCounts.RemoveAtSwap(Index, 1, false);
+	NextLookPoints.RemoveAtSwap(Index, 1, false);
+
+	DEC_DWORD_STAT(STAT_PacificatorsInField);
+
+	// Compacting copies every look point, only worth it once half of them belong to nobody
+	if (NumStaleLookPoints * 2 <= LookPoints.Num())
+		return;
+
+	TArray<FVector> CompactedLookPoints;
+	CompactedLookPoints.Reserve(LookPoints.Num() - NumStaleLookPoints);
+	for (int32 TurretIndex = 0; TurretIndex < LookPointOffsets.Num(); ++TurretIndex)
+	{
+		const int32 Offset = CompactedLookPoints.Num();
+		CompactedLookPoints.Append(LookPoints.GetData() + LookPointOffsets[TurretIndex], LookPointCounts[TurretIndex]);
+		LookPointOffsets[TurretIndex] = Offset;
+	}
+	LookPoints = MoveTemp(CompactedLookPoints);
+	NumStaleLookPoints = 0;
+}
+
+void UPacificatorFieldSubsystem::UpdatePromotion()
+{
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_PacificatorFieldPromotion);
+
+	const float PromoteDistance = GetPromoteDistance();
+	const float PromoteDistanceSquared = FMath::Square(PromoteDistance);
+
+	// A plain distance test over the packed locations, 10k turrets times a handful of players is a few microseconds
+	for (int32 Index = Classes.Num() - 1; Index >= 0; --Index)
+	{
+		if (!IsEnabled() || GetNearestTargetDistanceSquared(Locations[Index]) < PromoteDistanceSquared)
+			Promote(Index);
+	}
+
+	if (!IsEnabled() || !PacificatorSubsystem)
+		return;
+
+	const float DemoteDistanceSquared = FMath::Square(PromoteDistance * FMath::Max(CVarPacificatorFieldDemoteScale.GetValueOnGameThread(), 1.f));
+
+	// Destroying a turret unregisters it, so the candidates are gathered first
+	TArray<APacificator*, TInlineAllocator<16>> ToDemote;
+	for (APacificator* Pacificator : PacificatorSubsystem->GetPacificators())
+	{
+		if (Pacificator->bUseTurretField && GetNearestTargetDistanceSquared(Pacificator->GetActorLocation()) > DemoteDistanceSquared)
+			ToDemote.Add(Pacificator);
+	}
+
+	for (APacificator* Pacificator : ToDemote)
+		Demote(Pacificator);
+}
+
+void UPacificatorFieldSubsystem::UpdateAim(float DeltaTime)
+{
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_PacificatorFieldAim);
+
+	const int32 NumTurrets = Classes.Num();
+	const double Now = GetWorld()->GetTimeSeconds();
+	const float LookInterval = FMath::Max(CVarPacificatorFieldLookInterval.GetValueOnGameThread(), 0.f);
+
+	// Picking a new look point is rare, it stays out of the hot loop
+	for (int32 Index = 0; Index < NumTurrets; ++Index)
+	{
+		if (NextLookTimes[Index] > Now || LookPointCounts[Index] == 0)
+			continue;
+
+		const FVector& LookPoint = LookPoints[LookPointOffsets[Index] + NextLookPoints[Index]];
+		NextLookPoints[Index] = (NextLookPoints[Index] + 1) % LookPointCounts[Index];
+
+		const FRotator Target = (LookPoint - Locations[Index]).Rotation();
+		TargetYaws[Index] = Target.Yaw;
+		TargetPitches[Index] = Target.Pitch;
+		NextLookTimes[Index] = Now + FMath::FRandRange(0.5f, 1.5f) * LookInterval;
+	}
+
+	// Same compensated RInterpTo step as the controllers, with one alpha for every turret since they all share
+	// the interval and the turn rate. The loop body is branch free arithmetic over packed floats.
+	const float Alpha = 1.f - FMath::Exp(-CVarPacificatorFieldTurnRate.GetValueOnGameThread() * DeltaTime);
+	const int32 NumBatches = FMath::DivideAndRoundUp(NumTurrets, AimBatchSize);
+	const bool bSingleThreaded = !CVarPacificatorFieldParallelAim.GetValueOnGameThread();
+
+	ParallelFor(NumBatches, [this, NumTurrets, Alpha](int32 Batch)
+	{
+		const int32 Start = Batch * AimBatchSize;
+		const int32 End = FMath::Min(Start + AimBatchSize, NumTurrets);
+
+		float* RESTRICT Yaw = Yaws.GetData();
+		float* RESTRICT Pitch = Pitches.GetData();
+		const float* RESTRICT TargetYaw = TargetYaws.GetData();
+		const float* RESTRICT TargetPitch = TargetPitches.GetData();
+		bool* RESTRICT Changed = RotationChanged.GetData();
+
+		for (int32 Index = Start; Index < End; ++Index)
+		{
+			// Shortest way around, wrapped into [-180, 180) without branching
+			float YawDelta = TargetYaw[Index] - Yaw[Index];
+			YawDelta -= 360.f * FMath::FloorToFloat((YawDelta + 180.f) * (1.f / 360.f));
+			const float PitchDelta = TargetPitch[Index] - Pitch[Index];
+
+			const float YawStep = YawDelta * Alpha;
+			const float PitchStep = PitchDelta * Alpha;
+			Yaw[Index] += YawStep;
+			Pitch[Index] += PitchStep;
+			Changed[Index] = FMath::Abs(YawStep) + FMath::Abs(PitchStep) > MinVisibleTurn;
+		}
+	}, bSingleThreaded);
+}
+
+void UPacificatorFieldSubsystem::UpdateVisuals()
+{
+	if (!Visuals)
+		return;
+
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_PacificatorFieldVisuals);
+
+	for (int32 Index = 0; Index < Classes.Num(); ++Index)
+	{
+		if (!RotationChanged[Index])
+			continue;
+
+		// Muzzle transforms aren't kept, nothing in the field shoots
+		const FPacificatorFieldParts& TurretParts = Parts[Index];
+		const FTransform RootTransform(FRotator(Pitches[Index], Yaws[Index], 0.f), Locations[Index], TurretParts.RootScale);
+		Visuals->UpdateInstanceTransform(TurretParts.LightInstance, TurretParts.LightRelative * RootTransform);
+		Visuals->UpdateInstanceTransform(TurretParts.BoxInstance, TurretParts.BoxRelative * RootTransform);
+		Visuals->UpdateInstanceTransform(TurretParts.LensInstance, TurretParts.LensRelative * RootTransform);
+	}
+}
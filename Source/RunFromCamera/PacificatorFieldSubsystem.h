@@ -0,0 +1,168 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Pacificator.h"
+#include "PacificatorFieldSubsystem.generated.h"
+
+class UPacificatorSubsystem;
+class UPacificatorVisualsSubsystem;
+
+/**
+ * Instanced meshes of one field turret and where they sit relative to its root.
+ */
+struct FPacificatorFieldParts
+{
+	FPacificatorInstanceHandle LightInstance;
+
+	FPacificatorInstanceHandle BoxInstance;
+
+	FPacificatorInstanceHandle LensInstance;
+
+	FTransform LightRelative;
+
+	FTransform BoxRelative;
+
+	FTransform LensRelative;
+
+	FVector RootScale = FVector::OneVector;
+};
+
+/**
+ * What can be set on a placed turret instance rather than on its class, put back on the turret when it is promoted.
+ */
+USTRUCT()
+struct FPacificatorFieldOverrides
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FPacificatorSightConfig SightConfig;
+
+	UPROPERTY()
+	FPacificatorSearchConfig SearchConfig;
+
+	UPROPERTY()
+	bool bUseTurretField = true;
+
+	UPROPERTY()
+	TArray<FName> Tags;
+
+	UPROPERTY()
+	TSubclassOf<AController> AIControllerClass;
+};
+
+/**
+ * Runs passive turrets far away from the player without an actor or a controller. A Pacificator that opted in
+ * with bUseTurretField is demoted once the player is far enough away: its state is copied into flat arrays
+ * here and the actor is destroyed. One batched pass turns all of them towards their look points, and a turret
+ * is spawned again at its current rotation as soon as the player comes close.
+ *
+ * Only searching turrets live in the field. Everything that can see or shoot the player is always a full actor.
+ */
+UCLASS()
+class RUNFROMCAMERA_API UPacificatorFieldSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	virtual void Deinitialize() override;
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual TStatId GetStatId() const override;
+
+	// False when RunFromCamera.TurretField.Enabled is off or the world is networked, turrets then stay actors
+	bool IsEnabled() const;
+
+	int32 GetNumFieldTurrets() const { return Classes.Num(); }
+
+	// Called by an opted in turret when it begins play, demotes it right away if the player is far enough
+	void NotifyPacificatorBeginPlay(APacificator* Pacificator);
+
+protected:
+	virtual bool DoesSupportWorldType(EWorldType::Type WorldType) const override;
+
+private:
+	// Takes over the turret's state and destroys it and its controller. False if it has to stay an actor.
+	bool Demote(APacificator* Pacificator);
+
+	// Spawns the turret at Index again and removes it from the field
+	void Promote(int32 Index);
+
+	void RemoveAt(int32 Index);
+
+	// Demotes actors far from every player and promotes field turrets near any of them
+	void UpdatePromotion();
+
+	// Fills TargetLocations from the Pacificator subsystem's sight targets
+	void GatherTargetLocations();
+
+	float GetNearestTargetDistanceSquared(const FVector& Location) const;
+
+	// Turns every field turret towards its look point, picks the next one once it had time to get there
+	void UpdateAim(float DeltaTime);
+
+	// Writes the instance transforms of turrets the aim pass turned
+	void UpdateVisuals();
+
+	bool CanDemote(const APacificator* Pacificator) const;
+
+	float GetPromoteDistance() const;
+
+	UPROPERTY()
+	UPacificatorSubsystem* PacificatorSubsystem = nullptr;
+
+	UPROPERTY()
+	UPacificatorVisualsSubsystem* Visuals = nullptr;
+
+	// Turret state, one entry per field turret in every array. Kept apart so the aim pass streams through
+	// exactly the data it needs.
+	UPROPERTY()
+	TArray<UClass*> Classes;
+
+	TArray<FVector> Locations;
+
+	TArray<float> Yaws;
+
+	TArray<float> Pitches;
+
+	TArray<float> TargetYaws;
+
+	TArray<float> TargetPitches;
+
+	TArray<double> NextLookTimes;
+
+	TArray<double> NextFireTimes;
+
+	// Set by the aim pass when the rotation moved enough to be drawn
+	TArray<bool> RotationChanged;
+
+	TArray<FPacificatorFieldParts> Parts;
+
+	UPROPERTY()
+	TArray<FPacificatorFieldOverrides> Overrides;
+
+	// Look points of every field turret back to back, a turret owns LookPointCounts[i] of them from LookPointOffsets[i]
+	TArray<FVector> LookPoints;
+
+	TArray<int32> LookPointOffsets;
+
+	TArray<int32> LookPointCounts;
+
+	TArray<int32> NextLookPoints;
+
+	// Look points of promoted turrets are left behind until this many pile up, then the array is compacted
+	int32 NumStaleLookPoints = 0;
+
+	// Where every player was at the start of the current promotion pass
+	TArray<FVector> TargetLocations;
+
+	float TimeSinceAimUpdate = 0.f;
+
+	float TimeSincePromotionUpdate = 0.f;
+};
@@ -0,0 +1,448 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PacificatorSubsystem.h"
+#include "RunFromCamera.h"
+#include "Pacificator.h"
+#include "PacificatorAIController.h"
+#include "LineOfSightSubsystem.h"
+#include "BulletCamFocusSubsystem.h"
+#include "BTService_PacificatorEnemyPosition.h"
+#include "BTTask_PacificatorRandomLookPoint.h"
+#include "BehaviorTree/BehaviorTree.h"
+#include "BehaviorTree/Composites/BTComposite_Sequence.h"
+#include "BehaviorTree/Tasks/BTTask_Wait.h"
+#include "Camera/PlayerCameraManager.h"
+#include "GameFramework/PlayerController.h"
+#include "GameFramework/Pawn.h"
+#include "ProfilingDebugging/CountersTrace.h"
+
+DECLARE_CYCLE_STAT(TEXT("Pacificator Significance"), STAT_PacificatorSignificance, STATGROUP_RunFromCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pacificators Full Rate"), STAT_PacificatorsFullRate, STATGROUP_RunFromCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pacificators Reduced Rate"), STAT_PacificatorsReducedRate, STATGROUP_RunFromCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pacificators Dormant"), STAT_PacificatorsDormant, STATGROUP_RunFromCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pacificators Engaged"), STAT_PacificatorsEngaged, STATGROUP_RunFromCamera);
+DECLARE_CYCLE_STAT(TEXT("Pacificator Sight"), STAT_PacificatorSight, STATGROUP_RunFromCamera);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Pacificator Sight Candidates"), STAT_PacificatorSightCandidates, STATGROUP_RunFromCamera);
+
+TRACE_DECLARE_INT_COUNTER(RunFromCamera_PacificatorsEngaged, TEXT("RunFromCamera/Pacificators Engaged"));
+
+static TAutoConsoleVariable<bool> CVarPacificatorSignificanceEnabled(
+	TEXT("RunFromCamera.Significance.Enabled"),
+	true,
+	TEXT("Move Pacificators between tick tiers based on how relevant they are to the player."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPacificatorSignificanceUpdateInterval(
+	TEXT("RunFromCamera.Significance.UpdateInterval"),
+	0.25f,
+	TEXT("Seconds between two significance passes over all Pacificators."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPacificatorFullRateDistance(
+	TEXT("RunFromCamera.Significance.FullRateDistance"),
+	3000.f,
+	TEXT("Turrets in view and closer than this tick every frame."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPacificatorReducedRateDistance(
+	TEXT("RunFromCamera.Significance.ReducedRateDistance"),
+	8000.f,
+	TEXT("Turrets closer than this, or in view, tick at the reduced rate. Everything else goes dormant."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPacificatorReducedTickInterval(
+	TEXT("RunFromCamera.Significance.ReducedTickInterval"),
+	0.2f,
+	TEXT("Tick interval in seconds of turrets in the reduced tier."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPacificatorFireRateScale(
+	TEXT("RunFromCamera.TurretFire.RateScale"),
+	1.f,
+	TEXT("Difficulty multiplier on the fire rate of every turret. 2 halves the cooldown between shots. Applies from the next shot."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarPacificatorNativeSight(
+	TEXT("RunFromCamera.TurretSight.Native"),
+	true,
+	TEXT("Decide turret sight in the Pacificator subsystem's grid instead of every controller's AI perception. Read when a controller begins play."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarPacificatorNativeBehaviorTree(
+	TEXT("RunFromCamera.TurretAI.NativeTree"),
+	true,
+	TEXT("Run Pacificator controllers on a tree built from the native look point task and enemy position service instead of the Blueprint tasks of PacificatorBT. Read when a controller starts its tree."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPacificatorSightUpdateInterval(
+	TEXT("RunFromCamera.TurretSight.UpdateInterval"),
+	0.1f,
+	TEXT("Seconds between two sight passes over the turrets near the player."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarPacificatorGridCellSize(
+	TEXT("RunFromCamera.TurretSight.GridCellSize"),
+	2000.f,
+	TEXT("Size in cm of a turret grid cell. Read when the world starts."),
+	ECVF_Default);
+
+void UPacificatorSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	LineOfSight = Collection.InitializeDependency<ULineOfSightSubsystem>();
+	BulletCamFocus = Collection.InitializeDependency<UBulletCamFocusSubsystem>();
+
+	GridCellSize = FMath::Max(CVarPacificatorGridCellSize.GetValueOnGameThread(), 100.f);
+}
+
+void UPacificatorSubsystem::Deinitialize()
+{
+	Pacificators.Empty();
+	Grid.Empty();
+	SightedPacificators.Empty();
+	SightCandidates.Empty();
+	SightTargets.Empty();
+	SignificanceViews.Empty();
+	LineOfSight = nullptr;
+	BulletCamFocus = nullptr;
+	NativeBehaviorTree = nullptr;
+
+	SET_DWORD_STAT(STAT_PacificatorsFullRate, 0);
+	SET_DWORD_STAT(STAT_PacificatorsReducedRate, 0);
+	SET_DWORD_STAT(STAT_PacificatorsDormant, 0);
+	SET_DWORD_STAT(STAT_PacificatorsEngaged, 0);
+	NumEngaged = 0;
+
+	Super::Deinitialize();
+}
+
+TStatId UPacificatorSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UPacificatorSubsystem, STATGROUP_Tickables);
+}
+
+bool UPacificatorSubsystem::DoesSupportWorldType(EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+float UPacificatorSubsystem::GetReducedTickInterval()
+{
+	return CVarPacificatorReducedTickInterval.GetValueOnGameThread();
+}
+
+float UPacificatorSubsystem::GetFireRateScale()
+{
+	return FMath::Max(CVarPacificatorFireRateScale.GetValueOnGameThread(), KINDA_SMALL_NUMBER);
+}
+
+bool UPacificatorSubsystem::IsNativeSightEnabled()
+{
+	return CVarPacificatorNativeSight.GetValueOnGameThread();
+}
+
+bool UPacificatorSubsystem::IsNativeBehaviorTreeEnabled()
+{
+	return CVarPacificatorNativeBehaviorTree.GetValueOnGameThread();
+}
+
+UBehaviorTree* UPacificatorSubsystem::GetNativeBehaviorTree(UBlackboardData* BlackboardAsset)
+{
+	if (NativeBehaviorTree && NativeBehaviorTree->BlackboardAsset == BlackboardAsset)
+		return NativeBehaviorTree;
+
+	// Same loop as PacificatorBT: pick the next look point and give the turret time to turn towards it. The
+	// service on the root keeps the enemy's position fresh the whole time, the controller only reads it while engaged.
+	UBehaviorTree* Tree = NewObject<UBehaviorTree>(this, MakeUniqueObjectName(this, UBehaviorTree::StaticClass(), TEXT("PacificatorNativeBT")), RF_Transient);
+	Tree->BlackboardAsset = BlackboardAsset;
+
+	UBTComposite_Sequence* Root = NewObject<UBTComposite_Sequence>(Tree);
+	Root->Services.Add(NewObject<UBTService_PacificatorEnemyPosition>(Tree));
+
+	UBTTask_Wait* Wait = NewObject<UBTTask_Wait>(Tree);
+	Wait->WaitTime = 3.f;
+	Wait->RandomDeviation = 1.f;
+
+	Root->Children.AddDefaulted_GetRef().ChildTask = NewObject<UBTTask_PacificatorRandomLookPoint>(Tree);
+	Root->Children.AddDefaulted_GetRef().ChildTask = Wait;
+
+	Tree->RootNode = Root;
+	NativeBehaviorTree = Tree;
+	return Tree;
+}
+
+FIntPoint UPacificatorSubsystem::GetCell(const FVector& Location) const
+{
+	return FIntPoint(FMath::FloorToInt(Location.X / GridCellSize), FMath::FloorToInt(Location.Y / GridCellSize));
+}
+
+void UPacificatorSubsystem::RegisterPacificator(APacificator* Pacificator)
+{
+	if (Pacificators.Contains(Pacificator))
+		return;
+
+	Pacificators.Add(Pacificator);
+	Grid.FindOrAdd(GetCell(Pacificator->GetActorLocation())).Add(Pacificator);
+
+	const FPacificatorSightConfig& SightConfig = Pacificator->GetSightConfig();
+	MaxSightRadius = FMath::Max3(MaxSightRadius, SightConfig.SightRadius, SightConfig.LoseSightRadius);
+}
+
+void UPacificatorSubsystem::UnregisterPacificator(APacificator* Pacificator)
+{
+	Pacificators.RemoveSwap(Pacificator);
+	SightedPacificators.Remove(Pacificator);
+
+	const FIntPoint Cell = GetCell(Pacificator->GetActorLocation());
+	TArray<APacificator*>* CellPacificators = Grid.Find(Cell);
+	if (CellPacificators && CellPacificators->RemoveSwap(Pacificator) > 0)
+	{
+		if (CellPacificators->Num() == 0)
+			Grid.Remove(Cell);
+		return;
+	}
+
+	// Something moved the turret after all, look for it everywhere
+	for (auto It = Grid.CreateIterator(); It; ++It)
+	{
+		if (It.Value().RemoveSwap(Pacificator) > 0)
+		{
+			if (It.Value().Num() == 0)
+				It.RemoveCurrent();
+			break;
+		}
+	}
+}
+
+void UPacificatorSubsystem::RegisterSightTarget(APawn* Target)
+{
+	SightTargets.AddUnique(Target);
+}
+
+void UPacificatorSubsystem::UnregisterSightTarget(APawn* Target)
+{
+	// Turrets that were looking at it hear about it in the next sight pass
+	SightTargets.RemoveSwap(Target);
+}
+
+void UPacificatorSubsystem::NotifyEngagedChanged(bool bEngaged)
+{
+	NumEngaged = FMath::Max(NumEngaged + (bEngaged ? 1 : -1), 0);
+}
+
+void UPacificatorSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	SET_DWORD_STAT(STAT_PacificatorsEngaged, NumEngaged);
+	CSV_CUSTOM_STAT(RunFromCamera, PacificatorsEngaged, NumEngaged, ECsvCustomStatOp::Set);
+	TRACE_COUNTER_SET(RunFromCamera_PacificatorsEngaged, NumEngaged);
+
+	// Turret controllers only exist on the server, clients have nobody to tell about sight
+	TimeSinceSightUpdate += DeltaTime;
+	if (IsNativeSightEnabled() && GetWorld()->GetNetMode() != NM_Client && TimeSinceSightUpdate >= CVarPacificatorSightUpdateInterval.GetValueOnGameThread())
+	{
+		TimeSinceSightUpdate = 0.f;
+		UpdateSight();
+	}
+
+	// Tiers stay frozen during bullet cam so its focus mode can put every turret's tick back the way it found it
+	TimeSinceSignificanceUpdate += DeltaTime;
+	if (TimeSinceSignificanceUpdate < CVarPacificatorSignificanceUpdateInterval.GetValueOnGameThread() || (BulletCamFocus && BulletCamFocus->IsFocusActive()))
+		return;
+
+	TimeSinceSignificanceUpdate = 0.f;
+	UpdateSignificance();
+}
+
+void UPacificatorSubsystem::UpdateSight()
+{
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_PacificatorSight);
+
+	// Every turret first picks the one target it traces to, the nearest in range and cone. The target it already
+	// sees stays ahead of closer ones, switching would throw away its trace result every pass.
+	SightCandidates.Reset();
+	if (MaxSightRadius > 0.f)
+	{
+		const int32 CellRange = FMath::CeilToInt(MaxSightRadius / GridCellSize);
+
+		for (APawn* Target : SightTargets)
+		{
+			if (!IsValid(Target))
+				continue;
+
+			// Every cell overlapping the square around the target that contains the largest sight radius
+			const FIntPoint TargetCell = GetCell(Target->GetActorLocation());
+			for (int32 X = -CellRange; X <= CellRange; ++X)
+			{
+				for (int32 Y = -CellRange; Y <= CellRange; ++Y)
+				{
+					const TArray<APacificator*>* CellPacificators = Grid.Find(TargetCell + FIntPoint(X, Y));
+					if (!CellPacificators)
+						continue;
+
+					for (APacificator* Pacificator : *CellPacificators)
+					{
+						INC_DWORD_STAT(STAT_PacificatorSightCandidates);
+
+						const bool bSeenBefore = SightedPacificators.FindRef(Pacificator) == Target;
+						float DistanceSquared = 0.f;
+						if (!IsInSightCone(Pacificator, Target, bSeenBefore, DistanceSquared))
+							continue;
+
+						if (bSeenBefore)
+							DistanceSquared = -1.f;
+
+						FSightCandidate* Candidate = SightCandidates.Find(Pacificator);
+						if (!Candidate)
+							SightCandidates.Add(Pacificator, { Target, DistanceSquared });
+						else if (DistanceSquared < Candidate->DistanceSquared)
+							*Candidate = { Target, DistanceSquared };
+					}
+				}
+			}
+		}
+	}
+
+	NewlySightedPacificators.Reset();
+	for (const TPair<APacificator*, FSightCandidate>& Candidate : SightCandidates)
+	{
+		const bool bSeenBefore = SightedPacificators.FindRef(Candidate.Key) == Candidate.Value.Target;
+		if (HasLineOfSight(Candidate.Key, Candidate.Value.Target, bSeenBefore))
+			NewlySightedPacificators.Add(Candidate.Key, Candidate.Value.Target);
+	}
+
+	// Only turrets whose result changed hear about it, the rest of the world is never touched
+	for (const TPair<APacificator*, APawn*>& Sighted : SightedPacificators)
+	{
+		if (!NewlySightedPacificators.Contains(Sighted.Key))
+		{
+			if (APacificatorAIController* PacificatorController = Cast<APacificatorAIController>(Sighted.Key->GetController()))
+				PacificatorController->SetSightedEnemy(nullptr);
+		}
+	}
+
+	for (const TPair<APacificator*, APawn*>& Sighted : NewlySightedPacificators)
+	{
+		if (SightedPacificators.FindRef(Sighted.Key) != Sighted.Value)
+		{
+			if (APacificatorAIController* PacificatorController = Cast<APacificatorAIController>(Sighted.Key->GetController()))
+				PacificatorController->SetSightedEnemy(Sighted.Value);
+		}
+	}
+
+	Swap(SightedPacificators, NewlySightedPacificators);
+}
+
+bool UPacificatorSubsystem::IsInSightCone(const APacificator* Pacificator, const APawn* Target, bool bSeenBefore, float& OutDistanceSquared) const
+{
+	const FPacificatorSightConfig& SightConfig = Pacificator->GetSightConfig();
+	const float Radius = bSeenBefore ? SightConfig.LoseSightRadius : SightConfig.SightRadius;
+
+	const FVector ToTarget = Target->GetActorLocation() - Pacificator->GetSightLocation();
+	OutDistanceSquared = ToTarget.SizeSquared();
+	if (OutDistanceSquared > FMath::Square(Radius))
+		return false;
+
+	const float CosHalfAngle = FMath::Cos(FMath::DegreesToRadians(SightConfig.PeripheralVisionHalfAngleDegrees));
+	return (ToTarget | Pacificator->GetActorForwardVector()) >= CosHalfAngle * FMath::Sqrt(OutDistanceSquared);
+}
+
+bool UPacificatorSubsystem::HasLineOfSight(const APacificator* Pacificator, const APawn* Target, bool bSeenBefore)
+{
+	if (!LineOfSight)
+		return false;
+
+	// The trace itself is budgeted by the line of sight scheduler. Turrets already engaged jump the queue so
+	// they lose the player promptly, and the answer used is whatever the latest unexpired result says.
+	const APacificatorAIController* PacificatorController = Cast<APacificatorAIController>(Pacificator->GetController());
+	const bool bEngaged = bSeenBefore || (PacificatorController && PacificatorController->GetState() == EPacificatorState::Engaged);
+	LineOfSight->RequestLineOfSight(Pacificator, Pacificator->GetSightLocation(), Target, bEngaged);
+
+	// No fresh result yet keeps the last answer, a turret under trace budget pressure neither drops nor picks up the player
+	bool bVisible = false;
+	if (!LineOfSight->GetLineOfSight(Pacificator, Target, bVisible))
+		return bSeenBefore;
+
+	return bVisible;
+}
+
+void UPacificatorSubsystem::UpdateSignificance()
+{
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_PacificatorSignificance);
+
+	const bool bEnabled = CVarPacificatorSignificanceEnabled.GetValueOnGameThread();
+
+	// One view per sight target, a turret gets the best tier any player gives it
+	SignificanceViews.Reset();
+	for (APawn* Target : SightTargets)
+	{
+		if (!IsValid(Target))
+			continue;
+
+		FSignificanceView& View = SignificanceViews.AddDefaulted_GetRef();
+		FRotator ViewRotation;
+		if (AController* Controller = Target->GetController())
+			Controller->GetPlayerViewPoint(View.Location, ViewRotation);
+		else
+			Target->GetActorEyesViewPoint(View.Location, ViewRotation);
+		View.Direction = ViewRotation.Vector();
+
+		// Pad the view cone a bit so turrets at the edge of the screen are never caught sleeping
+		const APlayerController* PlayerController = Cast<APlayerController>(Target->GetController());
+		const float FOVAngle = PlayerController && PlayerController->PlayerCameraManager ? PlayerController->PlayerCameraManager->GetFOVAngle() : 90.f;
+		View.CosHalfViewAngle = FMath::Cos(FMath::DegreesToRadians(FMath::Min(FOVAngle * 0.5f + 15.f, 180.f)));
+	}
+
+	// Without a player to score against every turret keeps ticking at full rate
+	if (!bEnabled || SignificanceViews.Num() == 0)
+	{
+		for (APacificator* Pacificator : Pacificators)
+		{
+			Pacificator->SetTickTier(EPacificatorTickTier::Full);
+		}
+		return;
+	}
+
+	const float FullRateDistanceSquared = FMath::Square(CVarPacificatorFullRateDistance.GetValueOnGameThread());
+	const float ReducedRateDistanceSquared = FMath::Square(CVarPacificatorReducedRateDistance.GetValueOnGameThread());
+
+	uint32 NumFullRate = 0;
+	uint32 NumReducedRate = 0;
+	uint32 NumDormant = 0;
+
+	for (APacificator* Pacificator : Pacificators)
+	{
+		const APacificatorAIController* PacificatorController = Cast<APacificatorAIController>(Pacificator->GetController());
+		const bool bSeesPlayer = PacificatorController && PacificatorController->IsEnemyInSight();
+
+		EPacificatorTickTier Tier = bSeesPlayer ? EPacificatorTickTier::Full : EPacificatorTickTier::Dormant;
+		for (int32 ViewIndex = 0; ViewIndex < SignificanceViews.Num() && Tier != EPacificatorTickTier::Full; ++ViewIndex)
+		{
+			const FSignificanceView& View = SignificanceViews[ViewIndex];
+			const FVector ToTurret = Pacificator->GetActorLocation() - View.Location;
+			const float DistanceSquared = ToTurret.SizeSquared();
+			const bool bInView = (ToTurret | View.Direction) >= View.CosHalfViewAngle * FMath::Sqrt(DistanceSquared);
+
+			if (bInView && DistanceSquared <= FullRateDistanceSquared)
+				Tier = EPacificatorTickTier::Full;
+			else if (bInView || DistanceSquared <= ReducedRateDistanceSquared)
+				Tier = EPacificatorTickTier::Reduced;
+		}
+
+		if (Tier == EPacificatorTickTier::Full)
+			++NumFullRate;
+		else if (Tier == EPacificatorTickTier::Reduced)
+			++NumReducedRate;
+		else
+			++NumDormant;
+
+		Pacificator->SetTickTier(Tier);
+	}
+
+	SET_DWORD_STAT(STAT_PacificatorsFullRate, NumFullRate);
+	SET_DWORD_STAT(STAT_PacificatorsReducedRate, NumReducedRate);
+	SET_DWORD_STAT(STAT_PacificatorsDormant, NumDormant);
+}
@@ -0,0 +1,154 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "PacificatorSubsystem.generated.h"
+
+class APacificator;
+class ULineOfSightSubsystem;
+class UBulletCamFocusSubsystem;
+class UBehaviorTree;
+class UBlackboardData;
+
+UENUM(BlueprintType)
+enum class EPacificatorTickTier : uint8
+{
+	Full = 0		UMETA(DisplayName = "Full"),
+	Reduced = 1		UMETA(DisplayName = "Reduced"),
+	Dormant = 2		UMETA(DisplayName = "Dormant")
+};
+
+/**
+ * Registry of every Pacificator in the world. A few times per second it scores each turret by its distance
+ * to the player, whether it is inside the player's view and whether it currently sees the player, and moves
+ * the turret and its controller between tick tiers.
+ *
+ * Turrets are also bucketed in a uniform grid on the XY plane. Sight is decided here rather than by each
+ * controller's perception: only turrets in cells within sight range of the player's cell are tested against
+ * their own FPacificatorSightConfig, everything further away costs nothing.
+ */
+UCLASS()
+class RUNFROMCAMERA_API UPacificatorSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	virtual void Deinitialize() override;
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual TStatId GetStatId() const override;
+
+	void RegisterPacificator(APacificator* Pacificator);
+
+	void UnregisterPacificator(APacificator* Pacificator);
+
+	const TArray<APacificator*>& GetPacificators() const { return Pacificators; }
+
+	// Pawns turrets look for, registered by the characters themselves whoever possesses them
+	void RegisterSightTarget(APawn* Target);
+
+	void UnregisterSightTarget(APawn* Target);
+
+	const TArray<APawn*>& GetSightTargets() const { return SightTargets; }
+
+	// Called by the controllers whenever a turret starts or stops engaging the player
+	void NotifyEngagedChanged(bool bEngaged);
+
+	int32 GetNumEngaged() const { return NumEngaged; }
+
+	// Largest sight or lose sight radius of any turret registered so far
+	float GetMaxSightRadius() const { return MaxSightRadius; }
+
+	// Tick interval used by turrets in the Reduced tier
+	static float GetReducedTickInterval();
+
+	// Multiplier on every turret's fire rate, above 1 turrets shoot more often
+	static float GetFireRateScale();
+
+	// True when RunFromCamera.TurretSight.Native is on and controllers should leave sight to this subsystem
+	static bool IsNativeSightEnabled();
+
+	// True when RunFromCamera.TurretAI.NativeTree is on and controllers should run GetNativeBehaviorTree
+	static bool IsNativeBehaviorTreeEnabled();
+
+	// Search loop built from the native behavior tree nodes, shared by every controller using the same blackboard
+	UBehaviorTree* GetNativeBehaviorTree(UBlackboardData* BlackboardAsset);
+
+protected:
+	virtual bool DoesSupportWorldType(EWorldType::Type WorldType) const override;
+
+private:
+	void UpdateSignificance();
+
+	// Tests the turrets around every sight target and tells the controllers whose sight result changed
+	void UpdateSight();
+
+	// Range and cone only, cheap enough to run for every target around the turret
+	bool IsInSightCone(const APacificator* Pacificator, const APawn* Target, bool bSeenBefore, float& OutDistanceSquared) const;
+
+	// The line trace is requested from ULineOfSightSubsystem, the answer is its latest result
+	bool HasLineOfSight(const APacificator* Pacificator, const APawn* Target, bool bSeenBefore);
+
+	FIntPoint GetCell(const FVector& Location) const;
+
+	UPROPERTY()
+	TArray<APacificator*> Pacificators;
+
+	UPROPERTY()
+	TArray<APawn*> SightTargets;
+
+	UPROPERTY()
+	ULineOfSightSubsystem* LineOfSight = nullptr;
+
+	UPROPERTY()
+	UBehaviorTree* NativeBehaviorTree = nullptr;
+
+	UPROPERTY()
+	UBulletCamFocusSubsystem* BulletCamFocus = nullptr;
+
+	float TimeSinceSignificanceUpdate = 0.f;
+
+	float TimeSinceSightUpdate = 0.f;
+
+	// Turrets don't move, so a turret stays in the cell it was registered in
+	TMap<FIntPoint, TArray<APacificator*>> Grid;
+
+	float GridCellSize = 2000.f;
+
+	// Largest lose sight radius of any registered turret, decides how many cells around the player are visited
+	float MaxSightRadius = 0.f;
+
+	struct FSignificanceView
+	{
+		FVector Location = FVector::ZeroVector;
+
+		FVector Direction = FVector::ForwardVector;
+
+		float CosHalfViewAngle = 0.f;
+	};
+
+	// Where every sight target looks from, gathered once per significance pass
+	TArray<FSignificanceView> SignificanceViews;
+
+	struct FSightCandidate
+	{
+		APawn* Target = nullptr;
+
+		float DistanceSquared = 0.f;
+	};
+
+	// Target each turret near a target traces to this pass. A turret only has one trace in flight at a time.
+	TMap<APacificator*, FSightCandidate> SightCandidates;
+
+	// Turrets that saw a target in the last sight pass, and which one
+	TMap<APacificator*, APawn*> SightedPacificators;
+
+	TMap<APacificator*, APawn*> NewlySightedPacificators;
+
+	int32 NumEngaged = 0;
+};
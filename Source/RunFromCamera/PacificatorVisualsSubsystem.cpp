@@ -0,0 +1,231 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "PacificatorVisualsSubsystem.h"
+#include "RunFromCamera.h"
+#include "Components/HierarchicalInstancedStaticMeshComponent.h"
+#include "Engine/World.h"
+
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pacificator Instances"), STAT_PacificatorInstances, STATGROUP_RunFromCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pacificator Instance Buckets"), STAT_PacificatorInstanceBuckets, STATGROUP_RunFromCamera);
+
+static TAutoConsoleVariable<bool> CVarPacificatorInstancedVisuals(
+	TEXT("RunFromCamera.TurretVisuals.Instanced"),
+	true,
+	TEXT("Draw turret meshes with shared instanced meshes. Read when a turret begins play."),
+	ECVF_Default);
+
+namespace
+{
+	const FTransform CollapsedInstance(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+}
+
+void UPacificatorVisualsSubsystem::Deinitialize()
+{
+	for (const FPacificatorInstanceBucket& Bucket : Buckets)
+	{
+		if (Bucket.Instances)
+			DEC_DWORD_STAT_BY(STAT_PacificatorInstances, Bucket.Instances->GetInstanceCount() - Bucket.FreeInstances.Num());
+	}
+	DEC_DWORD_STAT_BY(STAT_PacificatorInstanceBuckets, Buckets.Num());
+
+	Buckets.Empty();
+	VisualsActor = nullptr;
+
+	Super::Deinitialize();
+}
+
+TStatId UPacificatorVisualsSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UPacificatorVisualsSubsystem, STATGROUP_Tickables);
+}
+
+bool UPacificatorVisualsSubsystem::DoesSupportWorldType(EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+bool UPacificatorVisualsSubsystem::IsEnabled() const
+{
+	return CVarPacificatorInstancedVisuals.GetValueOnGameThread() && FApp::CanEverRender();
+}
+
+void UPacificatorVisualsSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	// Turrets register and turn one by one, each bucket goes to the renderer at most once a frame for all of them
+	for (FPacificatorInstanceBucket& Bucket : Buckets)
+	{
+		if (!Bucket.Instances)
+			continue;
+
+		if (Bucket.bTreeOutOfDate)
+		{
+			CastChecked<UHierarchicalInstancedStaticMeshComponent>(Bucket.Instances)->BuildTreeIfOutdated(true, false);
+			Bucket.bTreeOutOfDate = false;
+		}
+
+		if (Bucket.bRenderStateDirty)
+		{
+			Bucket.Instances->MarkRenderStateDirty();
+			Bucket.bRenderStateDirty = false;
+		}
+	}
+}
+
+FPacificatorInstanceHandle UPacificatorVisualsSubsystem::AddInstance(const UStaticMeshComponent* Component, UMaterialInterface* OverrideMaterial, float CustomData, bool bMovable)
+{
+	FPacificatorInstanceHandle Handle;
+	if (!Component || !Component->GetStaticMesh())
+		return Handle;
+
+	Handle.BucketIndex = FindOrAddBucket(Component, OverrideMaterial, bMovable);
+	if (Handle.BucketIndex == INDEX_NONE)
+		return Handle;
+
+	FPacificatorInstanceBucket& Bucket = Buckets[Handle.BucketIndex];
+	if (Bucket.FreeInstances.Num() > 0)
+	{
+		Handle.InstanceIndex = Bucket.FreeInstances.Pop(false);
+		Bucket.Instances->UpdateInstanceTransform(Handle.InstanceIndex, Component->GetComponentTransform(), true, false, true);
+	}
+	else
+	{
+		Handle.InstanceIndex = Bucket.Instances->AddInstance(Component->GetComponentTransform(), true);
+	}
+
+	Bucket.Instances->SetCustomDataValue(Handle.InstanceIndex, 0, CustomData, true);
+	Bucket.bTreeOutOfDate = !Bucket.bMovable;
+	INC_DWORD_STAT(STAT_PacificatorInstances);
+
+	return Handle;
+}
+
+void UPacificatorVisualsSubsystem::UpdateInstance(FPacificatorInstanceHandle& Handle, const UStaticMeshComponent* Component, UMaterialInterface* OverrideMaterial, float CustomData)
+{
+	if (!Handle.IsValid() || !Buckets.IsValidIndex(Handle.BucketIndex))
+		return;
+
+	// A light material reading the custom data keeps the instance where it is, only a different material moves it
+	const bool bMovable = Buckets[Handle.BucketIndex].bMovable;
+	const int32 BucketIndex = FindOrAddBucket(Component, OverrideMaterial, bMovable);
+	if (BucketIndex == Handle.BucketIndex)
+	{
+		Buckets[BucketIndex].Instances->SetCustomDataValue(Handle.InstanceIndex, 0, CustomData, true);
+		return;
+	}
+
+	RemoveInstance(Handle);
+	Handle = AddInstance(Component, OverrideMaterial, CustomData, bMovable);
+}
+
+void UPacificatorVisualsSubsystem::UpdateInstanceTransform(const FPacificatorInstanceHandle& Handle, const FTransform& WorldTransform)
+{
+	if (!Handle.IsValid() || !Buckets.IsValidIndex(Handle.BucketIndex))
+		return;
+
+	FPacificatorInstanceBucket& Bucket = Buckets[Handle.BucketIndex];
+	if (!Bucket.Instances)
+		return;
+
+	// Every turret turning this frame only queues its transform, Tick sends the whole bucket once
+	if (Bucket.bMovable)
+	{
+		Bucket.Instances->UpdateInstanceTransform(Handle.InstanceIndex, WorldTransform, true, false, false);
+		Bucket.bRenderStateDirty = true;
+	}
+	else
+	{
+		Bucket.Instances->UpdateInstanceTransform(Handle.InstanceIndex, WorldTransform, true, true, false);
+		Bucket.bTreeOutOfDate = true;
+	}
+}
+
+void UPacificatorVisualsSubsystem::RemoveInstance(FPacificatorInstanceHandle& Handle)
+{
+	if (Handle.IsValid() && Buckets.IsValidIndex(Handle.BucketIndex))
+	{
+		// Removing would renumber the other instances of the bucket, collapsing keeps every handle valid
+		FPacificatorInstanceBucket& Bucket = Buckets[Handle.BucketIndex];
+		if (Bucket.Instances)
+		{
+			Bucket.Instances->UpdateInstanceTransform(Handle.InstanceIndex, CollapsedInstance, true, true, true);
+			Bucket.FreeInstances.Add(Handle.InstanceIndex);
+			DEC_DWORD_STAT(STAT_PacificatorInstances);
+		}
+	}
+
+	Handle = FPacificatorInstanceHandle();
+}
+
+int32 UPacificatorVisualsSubsystem::FindOrAddBucket(const UStaticMeshComponent* Component, UMaterialInterface* OverrideMaterial, bool bMovable)
+{
+	UStaticMesh* Mesh = Component->GetStaticMesh();
+
+	TArray<UMaterialInterface*, TInlineAllocator<4>> Materials;
+	for (int32 MaterialIndex = 0; MaterialIndex < Component->GetNumMaterials(); ++MaterialIndex)
+	{
+		Materials.Add(MaterialIndex == 0 && OverrideMaterial ? OverrideMaterial : Component->GetMaterial(MaterialIndex));
+	}
+
+	// A turret is made of a few distinct parts, a linear search is all this needs
+	for (int32 BucketIndex = 0; BucketIndex < Buckets.Num(); ++BucketIndex)
+	{
+		const FPacificatorInstanceBucket& Bucket = Buckets[BucketIndex];
+		if (Bucket.Mesh == Mesh && Bucket.bMovable == bMovable && Bucket.Materials.Num() == Materials.Num()
+			&& FMemory::Memcmp(Bucket.Materials.GetData(), Materials.GetData(), Materials.Num() * Materials.GetTypeSize()) == 0)
+			return BucketIndex;
+	}
+
+	UWorld* World = GetWorld();
+	if (!World)
+		return INDEX_NONE;
+
+	if (!VisualsActor)
+	{
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.ObjectFlags |= RF_Transient;
+		VisualsActor = World->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, SpawnParams);
+	}
+
+	UInstancedStaticMeshComponent* Instances;
+	if (bMovable)
+	{
+		Instances = NewObject<UInstancedStaticMeshComponent>(VisualsActor, NAME_None, RF_Transient);
+	}
+	else
+	{
+		UHierarchicalInstancedStaticMeshComponent* HierarchicalInstances = NewObject<UHierarchicalInstancedStaticMeshComponent>(VisualsActor, NAME_None, RF_Transient);
+		HierarchicalInstances->bAutoRebuildTreeOnInstanceChanges = false;
+		Instances = HierarchicalInstances;
+	}
+
+	Instances->SetMobility(EComponentMobility::Movable);
+	Instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Instances->SetCanEverAffectNavigation(false);
+	Instances->SetStaticMesh(Mesh);
+	for (int32 MaterialIndex = 0; MaterialIndex < Materials.Num(); ++MaterialIndex)
+	{
+		Instances->SetMaterial(MaterialIndex, Materials[MaterialIndex]);
+	}
+	Instances->CastShadow = Component->CastShadow;
+	Instances->SetNumCustomDataFloats(1);
+
+	if (USceneComponent* Root = VisualsActor->GetRootComponent())
+		Instances->SetupAttachment(Root);
+	else
+		VisualsActor->SetRootComponent(Instances);
+
+	Instances->RegisterComponent();
+	VisualsActor->AddInstanceComponent(Instances);
+
+	FPacificatorInstanceBucket& Bucket = Buckets.AddDefaulted_GetRef();
+	Bucket.Instances = Instances;
+	Bucket.Mesh = Mesh;
+	Bucket.bMovable = bMovable;
+	Bucket.Materials.Append(Materials);
+	INC_DWORD_STAT(STAT_PacificatorInstanceBuckets);
+
+	return Buckets.Num() - 1;
+}
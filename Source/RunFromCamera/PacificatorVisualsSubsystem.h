@@ -0,0 +1,97 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "PacificatorVisualsSubsystem.generated.h"
+
+class UInstancedStaticMeshComponent;
+class UStaticMeshComponent;
+
+/**
+ * What a turret keeps of one of its instanced meshes: which bucket it lives in and its slot there.
+ */
+struct FPacificatorInstanceHandle
+{
+	int32 BucketIndex = INDEX_NONE;
+
+	int32 InstanceIndex = INDEX_NONE;
+
+	bool IsValid() const { return BucketIndex != INDEX_NONE; }
+};
+
+/**
+ * Every turret part drawn with the same mesh and materials that either moves or doesn't.
+ */
+USTRUCT()
+struct FPacificatorInstanceBucket
+{
+	GENERATED_BODY()
+
+	// Hierarchical for parts that stay put, plain for moving ones which would invalidate the tree every time they turn
+	UPROPERTY()
+	UInstancedStaticMeshComponent* Instances = nullptr;
+
+	UPROPERTY()
+	UStaticMesh* Mesh = nullptr;
+
+	UPROPERTY()
+	TArray<UMaterialInterface*> Materials;
+
+	// Slots of removed instances, collapsed to zero scale until a new part takes them
+	TArray<int32> FreeInstances;
+
+	bool bMovable = false;
+
+	bool bTreeOutOfDate = false;
+
+	// Transforms of a movable bucket are sent to the renderer together once a frame
+	bool bRenderStateDirty = false;
+};
+
+/**
+ * Draws the static meshes of every Pacificator with one instanced mesh per mesh, material set and mobility, so
+ * a level full of turrets costs a handful of draw calls instead of three primitives per turret. Parts that never
+ * move after they are added go into hierarchical instanced meshes, parts that turn with the turret into plain ones.
+ * Per-instance custom data slot 0 carries the light state (0 neutral, 1 enemy spotted).
+ */
+UCLASS()
+class RUNFROMCAMERA_API UPacificatorVisualsSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual TStatId GetStatId() const override;
+
+	// False when RunFromCamera.TurretVisuals.Instanced is off or nothing can be rendered, turrets then draw their own components
+	bool IsEnabled() const;
+
+	// Adds an instance looking like Component at its current world transform. OverrideMaterial replaces material slot 0.
+	// Only pass bMovable false for parts that don't move once added.
+	FPacificatorInstanceHandle AddInstance(const UStaticMeshComponent* Component, UMaterialInterface* OverrideMaterial = nullptr, float CustomData = 0.f, bool bMovable = true);
+
+	// Moves the instance to the bucket matching Material if needed and writes its custom data
+	void UpdateInstance(FPacificatorInstanceHandle& Handle, const UStaticMeshComponent* Component, UMaterialInterface* OverrideMaterial, float CustomData);
+
+	void UpdateInstanceTransform(const FPacificatorInstanceHandle& Handle, const FTransform& WorldTransform);
+
+	void RemoveInstance(FPacificatorInstanceHandle& Handle);
+
+protected:
+	virtual bool DoesSupportWorldType(EWorldType::Type WorldType) const override;
+
+private:
+	int32 FindOrAddBucket(const UStaticMeshComponent* Component, UMaterialInterface* OverrideMaterial, bool bMovable);
+
+	UPROPERTY()
+	TArray<FPacificatorInstanceBucket> Buckets;
+
+	// Owns the instanced mesh components
+	UPROPERTY()
+	AActor* VisualsActor = nullptr;
+};
@@ -2,11 +2,59 @@
 
 
 #include "Projectile.h"
-#include "Pacificator.h"
 #include "GameFramework/SpringArmComponent.h"
 #include "Camera/CameraComponent.h"
-#include "Kismet/GameplayStatics.h"
+#include "RunFromCamera.h"
+#include "BulletCamRig.h"
+#include "HitEventBusSubsystem.h"
 #include "RunFromCameraCharacter.h"
+#include "EngineUtils.h"
+#include "Serialization/ArchiveCountMem.h"
+
+DECLARE_CYCLE_STAT(TEXT("Projectile OnHit"), STAT_ProjectileOnHit, STATGROUP_RunFromCamera);
+
+static FAutoConsoleCommandWithWorld ReportProjectileSizeCommand(
+	TEXT("RunFromCamera.Projectiles.ReportSize"),
+	TEXT("Logs the memory taken by one projectile actor and each of its components, and what the camera components each bullet used to carry would add."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		TActorIterator<AProjectile> It(World);
+		if (!It)
+		{
+			UE_LOG(LogRunFromCamera, Display, TEXT("No projectile in the world to measure"));
+			return;
+		}
+
+		// Object size is sizeof the class including Blueprint properties, serialized size is what FArchiveCountMem finds
+		// behind it, resource size is what the object reports for itself
+		auto ReportObject = [](UObject* Object, const TCHAR* Indent, SIZE_T& TotalBytes)
+		{
+			FArchiveCountMem ObjectMem(Object);
+			const SIZE_T ObjectBytes = Object->GetClass()->GetStructureSize();
+			const SIZE_T ResourceBytes = Object->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+			TotalBytes += ObjectBytes + ObjectMem.GetMax() + ResourceBytes;
+			UE_LOG(LogRunFromCamera, Display, TEXT("%s%s (%s): object %llu, serialized %llu, resource %llu bytes"), Indent, *Object->GetName(), *Object->GetClass()->GetName(),
+				(uint64)ObjectBytes, (uint64)ObjectMem.GetMax(), (uint64)ResourceBytes);
+		};
+
+		AProjectile* Projectile = *It;
+		SIZE_T TotalBytes = 0;
+		ReportObject(Projectile, TEXT(""), TotalBytes);
+
+		TInlineComponentArray<UActorComponent*> Components(Projectile);
+		for (UActorComponent* Component : Components)
+			ReportObject(Component, TEXT("  "), TotalBytes);
+
+		UE_LOG(LogRunFromCamera, Display, TEXT("Bytes per projectile: %llu across %d components"), (uint64)TotalBytes, Components.Num());
+
+		// The root scene component, spring arm and camera every bullet created before the shared rig, measured from
+		// their class defaults so the comparison needs only this build
+		SIZE_T CameraBytes = 0;
+		for (UClass* CameraClass : { USceneComponent::StaticClass(), USpringArmComponent::StaticClass(), UCameraComponent::StaticClass() })
+			ReportObject(CameraClass->GetDefaultObject(), TEXT("  removed "), CameraBytes);
+
+		UE_LOG(LogRunFromCamera, Display, TEXT("Bytes per projectile with its own bullet cam: %llu across %d components"), (uint64)(TotalBytes + CameraBytes), Components.Num() + 3);
+	}));
 
 // Sets default values
 AProjectile::AProjectile()
@@ -14,9 +62,6 @@ AProjectile::AProjectile()
  	// Set this actor to call Tick() every frame.  You can turn this off to improve performance if you don't need it.
 	PrimaryActorTick.bCanEverTick = true;
 
-	if (!RootComponent)
-		RootComponent = CreateDefaultSubobject<USceneComponent>(TEXT("ProjectileSceneComponent"));
-	
 	if (!CollisionComponent)
 	{
 		CollisionComponent = CreateDefaultSubobject<USphereComponent>(TEXT("SphereComponent"));
@@ -36,16 +81,11 @@ AProjectile::AProjectile()
 		ProjectileMovementComponent->ProjectileGravityScale = 0.0f;
 	}
 
-	CameraBoom = CreateDefaultSubobject<USpringArmComponent>(TEXT("CameraBoom"));
-	CameraBoom->SetupAttachment(RootComponent);
-	CameraBoom->TargetArmLength = 200.0f;
-	CameraBoom->bUsePawnControlRotation = true;
-
-	BulletCam = CreateDefaultSubobject<UCameraComponent>(TEXT("BulletCam"));
-	BulletCam->SetupAttachment(CameraBoom, USpringArmComponent::SocketName);
-	BulletCam->bUsePawnControlRotation = false;
+	// The bullet cam components live on the shared ABulletCamRig and are only hooked up for the followed bullet
+	CameraBoom = nullptr;
+	BulletCam = nullptr;
 
-	CollisionComponent->BodyInstance.SetCollisionProfileName(TEXT("Projectile"));
+	CollisionComponent->BodyInstance.SetCollisionProfileName(TEXT("PlayerProjectile"));
 	CollisionComponent->OnComponentHit.AddDynamic(this, &AProjectile::OnHit);
 
 	InitialLifeSpan = 3.0f;
@@ -56,7 +96,8 @@ AProjectile::AProjectile()
 void AProjectile::BeginPlay()
 {
 	Super::BeginPlay();
-	
+
+	HitEventBus = GetWorld()->GetSubsystem<UHitEventBusSubsystem>();
 }
 
 // Called every frame
@@ -71,43 +112,93 @@ void AProjectile::FireInDirection(const FVector& ShootDirection)
 	ProjectileMovementComponent->Velocity = ShootDirection * ProjectileMovementComponent->InitialSpeed;
 }
 
-void AProjectile::OnHit(UPrimitiveComponent* HitComponent, AActor* OtherActor, UPrimitiveComponent* OtherComponent, FVector NormalImpulse, const FHitResult& Hit)
+void AProjectile::ActivateFromPool(const FProjectilePreset& Preset)
 {
-	if ( !ProjectileMovementComponent->bShouldBounce )
-		Destroy();
+	bInPool = false;
+	bBulletCamActive = false;
+
+	// StopSimulating() clears the updated component when a non-bouncing bullet hits something
+	ProjectileMovementComponent->SetUpdatedComponent(CollisionComponent);
+	ProjectileMovementComponent->InitialSpeed = Preset.InitialSpeed;
+	ProjectileMovementComponent->MaxSpeed = Preset.MaxSpeed;
+	ProjectileMovementComponent->bShouldBounce = Preset.bShouldBounce;
+	ProjectileMovementComponent->Activate(true);
+
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+	SetActorTickEnabled(true);
+	SetLifeSpan(Preset.LifeSpan);
+}
+
+void AProjectile::DeactivateForPool()
+{
+	bInPool = true;
+	bBulletCamActive = false;
+
+	// Don't leave the shared rig following a bullet that is back in the pool
+	if ( ABulletCamRig* Rig = BulletCam ? Cast<ABulletCamRig>(BulletCam->GetOwner()) : nullptr )
+		Rig->DetachFromProjectile();
+
+	SetLifeSpan(0.f);
+	ProjectileMovementComponent->StopMovementImmediately();
+	ProjectileMovementComponent->Deactivate();
+
+	SetActorTickEnabled(false);
+	SetActorEnableCollision(false);
+	SetActorHiddenInGame(true);
+}
 
-	APlayerController* OurPlayerController = UGameplayStatics::GetPlayerController(this, 0);
-	ARunFromCameraCharacter* RFC = Cast<ARunFromCameraCharacter>(OurPlayerController->GetPawn());
+void AProjectile::Release()
+{
+	if ( bInPool )
+		return;
 
+	// Expired without hitting anything, so the hit event bus will never hand the shooter's camera back
 	if ( bBulletCamActive )
 	{
-		if (IsValid(RFC))
-		{
-			bBulletCamActive = false;
-			RFC->ResetCameraAfterBulletCam();
-			ProjectileMovementComponent->InitialSpeed = 3000.0f;
-			ProjectileMovementComponent->MaxSpeed = 3000.0f;
-		}
-	}
+		bBulletCamActive = false;
 
-	if (OtherActor->IsA(APacificator::StaticClass()))
-	{
-		if (IsValid(RFC))
-		{
-			if (RFC->GetCurrentCamera() == ECameraType::FirstPerson)
-			{
-				RFC->AddPoints(1);
-			}
-			else
-			{
-				RFC->AddPoints(5);
-				Destroy();
-			}
-		}
+		ARunFromCameraCharacter* Shooter = Cast<ARunFromCameraCharacter>(GetOwner());
+		if ( IsValid(Shooter) && Shooter->GetCurrentCamera() == ECameraType::BulletCam )
+			Shooter->ResetCameraAfterBulletCam();
 	}
 
-	if (IsValid(RFC) && OtherActor->IsA(ARunFromCameraCharacter::StaticClass()))
+	UProjectilePoolSubsystem* Pool = bPooled ? GetWorld()->GetSubsystem<UProjectilePoolSubsystem>() : nullptr;
+	if ( Pool )
+		Pool->Release(this);
+	else
+		Destroy();
+}
+
+void AProjectile::LifeSpanExpired()
+{
+	Release();
+}
+
+void AProjectile::CalcCamera(float DeltaTime, FMinimalViewInfo& OutResult)
+{
+	// The rig is a separate actor, so the default search through our own components would never find its camera
+	if ( BulletCam && BulletCam->IsActive() )
 	{
-		RFC->Die();
+		BulletCam->GetCameraView(DeltaTime, OutResult);
+		return;
 	}
-}
\ No newline at end of file
+
+	Super::CalcCamera(DeltaTime, OutResult);
+}
+
+void AProjectile::OnHit(UPrimitiveComponent* HitComponent, AActor* OtherActor, UPrimitiveComponent* OtherComponent, FVector NormalImpulse, const FHitResult& Hit)
+{
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_ProjectileOnHit);
+
+	if ( bInPool )
+		return;
+
+	// Scoring, deaths and the bullet cam reset are resolved later in the frame by the hit event bus
+	const bool bWasBulletCam = bBulletCamActive;
+	bBulletCamActive = false;
+
+	const bool bShouldBounce = ProjectileMovementComponent->bShouldBounce;
+	if ( HitEventBus ? HitEventBus->QueueHit(GetOwner(), Hit, bShouldBounce, GetNetMode() != NM_Client, bWasBulletCam) : !bShouldBounce )
+		Release();
+}
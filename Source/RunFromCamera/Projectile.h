@@ -6,6 +6,7 @@
 #include "GameFramework/Actor.h"
 #include <Components/SphereComponent.h>
 #include <GameFramework/ProjectileMovementComponent.h>
+#include "ProjectilePoolSubsystem.h"
 #include "Projectile.generated.h"
 
 
@@ -37,10 +38,29 @@ public:
 
 	void SetIsBulletCamActive(bool value) { bBulletCamActive = value; }
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
+	// Puts a pooled projectile back into play with the shooter's preset
+	void ActivateFromPool(const FProjectilePreset& Preset);
+
+	// Stops, hides and disables collision so the projectile can wait in the pool
+	void DeactivateForPool();
+
+	// Returns the projectile to the pool, or destroys it when it was not spawned by the pool
+	void Release();
+
+	void MarkPooled() { bPooled = true; }
+
+	bool IsInPool() const { return bInPool; }
+
+	virtual void LifeSpanExpired() override;
+
+	// Views through the bullet cam rig while it is attached to us
+	virtual void CalcCamera(float DeltaTime, struct FMinimalViewInfo& OutResult) override;
+
+	// Both point at the shared ABulletCamRig while this projectile is followed by the bullet cam and are null otherwise
+	UPROPERTY(VisibleAnywhere, Transient, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
 	class USpringArmComponent* CameraBoom;
 
-	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
+	UPROPERTY(VisibleAnywhere, Transient, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
 	class UCameraComponent* BulletCam;
 
 	UPROPERTY(VisibleDefaultsOnly, Category = "Projectile | Collision")
@@ -50,8 +70,16 @@ public:
 	UProjectileMovementComponent* ProjectileMovementComponent;
 
 private:
+	// Cached in BeginPlay, OnHit only appends to it
+	UPROPERTY(Transient)
+	class UHitEventBusSubsystem* HitEventBus = nullptr;
+
 	bool bBulletCamActive;
 
+	bool bPooled = false;
+
+	bool bInPool = false;
+
 	float MaxBulletSpeed = 3000.0f;
 	float InitialBulletSpeed = 3000.0f;
 };
@@ -0,0 +1,455 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ProjectileManagerSubsystem.h"
+#include "RunFromCamera.h"
+#include "Projectile.h"
+#include "PacificatorSubsystem.h"
+#include "HitEventBusSubsystem.h"
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/BlueprintGeneratedClass.h"
+#include "Engine/CollisionProfile.h"
+#include "Engine/NetDriver.h"
+#include "Engine/SCS_Node.h"
+#include "Engine/SimpleConstructionScript.h"
+#include "GameFramework/GameStateBase.h"
+#include "Kismet/KismetMathLibrary.h"
+#include "ProfilingDebugging/CountersTrace.h"
+#include "UObject/CoreNet.h"
+
+DECLARE_CYCLE_STAT(TEXT("Simulate Projectiles"), STAT_SimulateProjectiles, STATGROUP_RunFromCamera);
+DECLARE_CYCLE_STAT(TEXT("Sweep Simulated Projectiles"), STAT_SweepSimulatedProjectiles, STATGROUP_RunFromCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Simulated Projectiles"), STAT_SimulatedProjectiles, STATGROUP_RunFromCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Live Projectiles"), STAT_LiveProjectiles, STATGROUP_RunFromCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Shots Per Second"), STAT_ShotsPerSecond, STATGROUP_RunFromCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Fire Event Bytes Per Second"), STAT_FireEventBytesPerSecond, STATGROUP_RunFromCamera);
+
+TRACE_DECLARE_INT_COUNTER(RunFromCamera_LiveProjectiles, TEXT("RunFromCamera/Live Projectiles"));
+TRACE_DECLARE_INT_COUNTER(RunFromCamera_ShotsPerSecond, TEXT("RunFromCamera/Shots Per Second"));
+
+static TAutoConsoleVariable<bool> CVarSimulateProjectiles(
+	TEXT("RunFromCamera.Projectiles.Simulate"),
+	true,
+	TEXT("Simulate bullets that don't need an actor in the projectile manager instead of spawning AProjectile actors."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarParallelProjectileSweeps(
+	TEXT("RunFromCamera.Projectiles.ParallelSweeps"),
+	true,
+	TEXT("Run the simulated projectile sweeps on worker threads."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarFireEventMaxFastForward(
+	TEXT("RunFromCamera.Net.MaxFastForward"),
+	0.25f,
+	TEXT("Most seconds a client fast-forwards a bullet fired on another machine to catch up with the server's copy."),
+	ECVF_Default);
+
+static FAutoConsoleCommandWithWorld ReportBandwidthCommand(
+	TEXT("RunFromCamera.Net.ReportBandwidth"),
+	TEXT("Logs the bandwidth taken by fire events and by the whole net driver, per second and per turret."),
+	FConsoleCommandWithWorldDelegate::CreateLambda([](UWorld* World)
+	{
+		if (const UProjectileManagerSubsystem* ProjectileManager = World ? World->GetSubsystem<UProjectileManagerSubsystem>() : nullptr)
+			ProjectileManager->ReportBandwidth();
+	}));
+
+bool FProjectileFireEvent::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	bool bLocationSuccess = true;
+	bool bDirectionSuccess = true;
+	MuzzleLocation.NetSerialize(Ar, Map, bLocationSuccess);
+	Direction.NetSerialize(Ar, Map, bDirectionSuccess);
+	Ar << ServerTime;
+	Ar << PresetIndex;
+
+	bOutSuccess = bLocationSuccess && bDirectionSuccess;
+	return true;
+}
+
+namespace
+{
+	// Blueprint added components only exist on the construction script, not on the class default object
+	const UStaticMeshComponent* FindMeshTemplate(UClass* ProjectileClass)
+	{
+		for (UClass* Class = ProjectileClass; Class; Class = Class->GetSuperClass())
+		{
+			const UBlueprintGeneratedClass* BlueprintClass = Cast<UBlueprintGeneratedClass>(Class);
+			if (!BlueprintClass || !BlueprintClass->SimpleConstructionScript)
+				continue;
+
+			for (const USCS_Node* Node : BlueprintClass->SimpleConstructionScript->GetAllNodes())
+			{
+				if (const UStaticMeshComponent* Mesh = Cast<UStaticMeshComponent>(Node->ComponentTemplate))
+					return Mesh;
+			}
+		}
+		return nullptr;
+	}
+}
+
+void UProjectileManagerSubsystem::Deinitialize()
+{
+	DEC_DWORD_STAT_BY(STAT_SimulatedProjectiles, Positions.Num());
+
+	Positions.Empty();
+	Velocities.Empty();
+	RemainingLife.Empty();
+	Owners.Empty();
+	TypeIndices.Empty();
+	BounceFlags.Empty();
+	Types.Empty();
+	VisualsActor = nullptr;
+
+	SET_DWORD_STAT(STAT_LiveProjectiles, 0);
+	SET_DWORD_STAT(STAT_ShotsPerSecond, 0);
+	SET_DWORD_STAT(STAT_FireEventBytesPerSecond, 0);
+
+	Super::Deinitialize();
+}
+
+TStatId UProjectileManagerSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UProjectileManagerSubsystem, STATGROUP_Tickables);
+}
+
+bool UProjectileManagerSubsystem::DoesSupportWorldType(EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+bool UProjectileManagerSubsystem::IsSimulationEnabled() const
+{
+	return CVarSimulateProjectiles.GetValueOnGameThread();
+}
+
+void UProjectileManagerSubsystem::Launch(TSubclassOf<AProjectile> ProjectileClass, const FVector& Location, const FVector& Direction, const FProjectilePreset& Preset, AActor* Owner)
+{
+	if (!ProjectileClass)
+		return;
+
+	const float Speed = FMath::Min(Preset.InitialSpeed, Preset.MaxSpeed);
+
+	Positions.Add(Location);
+	Velocities.Add(Direction.GetSafeNormal() * Speed);
+	RemainingLife.Add(Preset.LifeSpan);
+	Owners.Add(Owner);
+	TypeIndices.Add(FindOrAddType(ProjectileClass, Preset.CollisionProfileName));
+	BounceFlags.Add(Preset.bShouldBounce);
+
+	INC_DWORD_STAT(STAT_SimulatedProjectiles);
+}
+
+void UProjectileManagerSubsystem::LaunchFromFireEvent(TSubclassOf<AProjectile> ProjectileClass, const FProjectileFireEvent& FireEvent, const FProjectilePreset& Preset, AActor* Owner)
+{
+	UWorld* World = GetWorld();
+	if (!ProjectileClass || !World)
+		return;
+
+	if (!IsSimulationEnabled())
+	{
+		UProjectilePoolSubsystem* Pool = World->GetSubsystem<UProjectilePoolSubsystem>();
+		AProjectile* Projectile = Pool ? Pool->Acquire(ProjectileClass, FireEvent.MuzzleLocation, FireEvent.Direction.Rotation(), Preset, Owner, Cast<APawn>(Owner)) : nullptr;
+		if (Projectile)
+			Projectile->FireInDirection(FireEvent.Direction);
+		return;
+	}
+
+	Launch(ProjectileClass, FireEvent.MuzzleLocation, FireEvent.Direction, Preset, Owner);
+
+	const AGameStateBase* GameState = World->GetGameState();
+	const float Latency = GameState ? (float)GameState->GetServerWorldTimeSeconds() - FireEvent.ServerTime : 0.f;
+	const float FastForward = FMath::Clamp(Latency, 0.f, CVarFireEventMaxFastForward.GetValueOnGameThread());
+	if (FastForward <= 0.f)
+		return;
+
+	// Catch up with the server's copy, sweeping the skipped stretch so the bullet can't tunnel through a wall.
+	// It stops short of whatever is in the way and the next tick hits it properly.
+	const int32 Index = Positions.Num() - 1;
+	const FSimulatedProjectileType& Type = Types[TypeIndices[Index]];
+	const FVector End = Positions[Index] + Velocities[Index] * FastForward;
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(SimulatedProjectileFastForward), false, Owner);
+	FHitResult Hit;
+	World->SweepSingleByChannel(Hit, Positions[Index], End, FQuat::Identity, Type.CollisionChannel, FCollisionShape::MakeSphere(Type.Radius), QueryParams, Type.ResponseParams);
+
+	Positions[Index] = Hit.bBlockingHit ? Hit.Location : End;
+	RemainingLife[Index] -= FastForward;
+}
+
+FProjectileFireEvent UProjectileManagerSubsystem::MakeFireEvent(const FVector& MuzzleLocation, const FVector& Direction, uint8 PresetIndex) const
+{
+	const AGameStateBase* GameState = GetWorld() ? GetWorld()->GetGameState() : nullptr;
+
+	FProjectileFireEvent FireEvent;
+	FireEvent.MuzzleLocation = MuzzleLocation;
+	FireEvent.Direction = Direction.GetSafeNormal();
+	FireEvent.ServerTime = GameState ? (float)GameState->GetServerWorldTimeSeconds() : 0.f;
+	FireEvent.PresetIndex = PresetIndex;
+	return FireEvent;
+}
+
+void UProjectileManagerSubsystem::RecordFireEventSent(const FProjectileFireEvent& FireEvent)
+{
+	// Measure the event the way it goes on the wire
+	FNetBitWriter Writer(nullptr, 512);
+	FProjectileFireEvent SentEvent = FireEvent;
+	bool bSuccess = true;
+	SentEvent.NetSerialize(Writer, nullptr, bSuccess);
+
+	++FireEventsThisSecond;
+	FireEventBitsThisSecond += Writer.GetNumBits();
+}
+
+void UProjectileManagerSubsystem::ReportBandwidth() const
+{
+	const UWorld* World = GetWorld();
+	const UNetDriver* NetDriver = World ? World->GetNetDriver() : nullptr;
+	if (!NetDriver)
+	{
+		UE_LOG(LogRunFromCamera, Display, TEXT("Bandwidth: no net driver, this world is not networked"));
+		return;
+	}
+
+	if (World->GetNetMode() == NM_Client)
+	{
+		UE_LOG(LogRunFromCamera, Display, TEXT("Bandwidth: fire events are sent by the server, run this there. Client in: %u B/s"), NetDriver->InBytesPerSecond);
+		return;
+	}
+
+	const UPacificatorSubsystem* PacificatorSubsystem = World->GetSubsystem<UPacificatorSubsystem>();
+	const int32 NumTurrets = FMath::Max(PacificatorSubsystem ? PacificatorSubsystem->GetPacificators().Num() : 0, 1);
+	const int32 NumClients = NetDriver->ClientConnections.Num();
+
+	// Each multicast goes to every client connection
+	const double FireEventBytes = FireEventBitsPerSecond / 8.0;
+	const double SentFireEventBytes = FireEventBytes * NumClients;
+
+	UE_LOG(LogRunFromCamera, Display, TEXT("Bandwidth: %d fire events/s, %.0f B/s of payload to each of %d clients, %.0f B/s sent"),
+		FireEventsPerSecond, FireEventBytes, NumClients, SentFireEventBytes);
+	UE_LOG(LogRunFromCamera, Display, TEXT("Bandwidth per turret (%d turrets): fire events %.1f B/s per client, net driver total %.1f B/s"),
+		NumTurrets, FireEventBytes / NumTurrets, (double)NetDriver->OutBytesPerSecond / NumTurrets);
+}
+
+void UProjectileManagerSubsystem::Tick(float DeltaTime)
+{
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_SimulateProjectiles);
+
+	Super::Tick(DeltaTime);
+
+	PublishCounters();
+
+	UWorld* World = GetWorld();
+	const int32 NumProjectiles = Positions.Num();
+	if (!World || NumProjectiles == 0)
+	{
+		UpdateVisuals();
+		return;
+	}
+
+	SweepHits.SetNum(NumProjectiles, false);
+	SweepOwners.SetNum(NumProjectiles, false);
+	for (int32 Index = 0; Index < NumProjectiles; ++Index)
+	{
+		RemainingLife[Index] -= DeltaTime;
+		SweepOwners[Index] = Owners[Index].Get();
+	}
+
+	// Collision queries don't touch game state, so every bullet is swept in one batch before any hit is handled
+	{
+		RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_SweepSimulatedProjectiles);
+
+		const bool bSingleThreaded = !CVarParallelProjectileSweeps.GetValueOnGameThread();
+		ParallelFor(NumProjectiles, [this, World, DeltaTime](int32 Index)
+		{
+			FHitResult& Hit = SweepHits[Index];
+			Hit.Reset(1.f, false);
+
+			if (RemainingLife[Index] <= 0.f)
+				return;
+
+			const FSimulatedProjectileType& Type = Types[TypeIndices[Index]];
+			const FVector Start = Positions[Index];
+			const FVector End = Start + Velocities[Index] * DeltaTime;
+
+			FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(SimulatedProjectileSweep), false, SweepOwners[Index]);
+			World->SweepSingleByChannel(Hit, Start, End, FQuat::Identity, Type.CollisionChannel, FCollisionShape::MakeSphere(Type.Radius), QueryParams, Type.ResponseParams);
+		}, bSingleThreaded);
+	}
+
+	// Clients fly bullets for show, only the server scores and kills
+	const bool bAuthority = World->GetNetMode() != NM_Client;
+	UHitEventBusSubsystem* HitEventBus = World->GetSubsystem<UHitEventBusSubsystem>();
+
+	// Walk backwards so RemoveAtSwap only ever pulls in bullets that were already handled
+	for (int32 Index = NumProjectiles - 1; Index >= 0; --Index)
+	{
+		if (RemainingLife[Index] <= 0.f)
+		{
+			RemoveProjectile(Index);
+			continue;
+		}
+
+		const FHitResult& Hit = SweepHits[Index];
+		if (!Hit.bBlockingHit)
+		{
+			Positions[Index] += Velocities[Index] * DeltaTime;
+			continue;
+		}
+
+		const bool bShouldBounce = BounceFlags[Index];
+		if (HitEventBus ? HitEventBus->QueueHit(Owners[Index].Get(), Hit, bShouldBounce, bAuthority) : !bShouldBounce)
+		{
+			RemoveProjectile(Index);
+			continue;
+		}
+
+		// Bounciness is 1 and there is no friction, so the bounce is a plain reflection
+		Positions[Index] = Hit.Location;
+		Velocities[Index] = UKismetMathLibrary::MirrorVectorByNormal(Velocities[Index], Hit.ImpactNormal);
+	}
+
+	UpdateVisuals();
+}
+
+void UProjectileManagerSubsystem::PublishCounters()
+{
+	// Real time, so bullet cam slow motion doesn't inflate the rate
+	ShotCounterTime += FApp::GetDeltaTime();
+	if (ShotCounterTime >= 1.f)
+	{
+		ShotsPerSecond = FMath::RoundToInt(ShotsThisSecond / ShotCounterTime);
+		ShotsThisSecond = 0;
+
+		FireEventsPerSecond = FMath::RoundToInt(FireEventsThisSecond / ShotCounterTime);
+		FireEventBitsPerSecond = FMath::RoundToInt(FireEventBitsThisSecond / ShotCounterTime);
+		FireEventsThisSecond = 0;
+		FireEventBitsThisSecond = 0;
+
+		ShotCounterTime = 0.f;
+	}
+
+	const UProjectilePoolSubsystem* Pool = GetWorld() ? GetWorld()->GetSubsystem<UProjectilePoolSubsystem>() : nullptr;
+	const int32 NumLiveProjectiles = Positions.Num() + (Pool ? Pool->GetNumActiveProjectiles() : 0);
+
+	SET_DWORD_STAT(STAT_LiveProjectiles, NumLiveProjectiles);
+	SET_DWORD_STAT(STAT_ShotsPerSecond, ShotsPerSecond);
+	SET_DWORD_STAT(STAT_FireEventBytesPerSecond, FireEventBitsPerSecond / 8);
+	CSV_CUSTOM_STAT(RunFromCamera, LiveProjectiles, NumLiveProjectiles, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(RunFromCamera, ShotsPerSecond, ShotsPerSecond, ECsvCustomStatOp::Set);
+	TRACE_COUNTER_SET(RunFromCamera_LiveProjectiles, NumLiveProjectiles);
+	TRACE_COUNTER_SET(RunFromCamera_ShotsPerSecond, ShotsPerSecond);
+}
+
+void UProjectileManagerSubsystem::RemoveProjectile(int32 Index)
+{
+	Positions.RemoveAtSwap(Index, 1, false);
+	Velocities.RemoveAtSwap(Index, 1, false);
+	RemainingLife.RemoveAtSwap(Index, 1, false);
+	Owners.RemoveAtSwap(Index, 1, false);
+	TypeIndices.RemoveAtSwap(Index, 1, false);
+	BounceFlags.RemoveAtSwap(Index);
+
+	DEC_DWORD_STAT(STAT_SimulatedProjectiles);
+}
+
+uint8 UProjectileManagerSubsystem::FindOrAddType(UClass* ProjectileClass, FName CollisionProfileName)
+{
+	for (int32 Index = 0; Index < Types.Num(); ++Index)
+	{
+		if (Types[Index].ProjectileClass == ProjectileClass && Types[Index].CollisionProfileName == CollisionProfileName)
+			return (uint8)Index;
+	}
+
+	check(Types.Num() < MAX_uint8);
+
+	FSimulatedProjectileType& Type = Types.AddDefaulted_GetRef();
+	Type.ProjectileClass = ProjectileClass;
+	Type.CollisionProfileName = CollisionProfileName;
+
+	if (!UCollisionProfile::GetChannelAndResponseParams(CollisionProfileName, Type.CollisionChannel, Type.ResponseParams))
+	{
+		UE_LOG(LogRunFromCamera, Warning, TEXT("Unknown collision profile %s for simulated projectiles"), *CollisionProfileName.ToString());
+	}
+
+	if (const AProjectile* DefaultProjectile = GetDefault<AProjectile>(ProjectileClass))
+	{
+		if (DefaultProjectile->CollisionComponent)
+			Type.Radius = DefaultProjectile->CollisionComponent->GetUnscaledSphereRadius();
+	}
+
+	Type.Visuals = CreateVisuals(ProjectileClass, Type.MeshTransform);
+
+	return (uint8)(Types.Num() - 1);
+}
+
+UInstancedStaticMeshComponent* UProjectileManagerSubsystem::CreateVisuals(UClass* ProjectileClass, FTransform& OutMeshTransform)
+{
+	UWorld* World = GetWorld();
+	const UStaticMeshComponent* MeshTemplate = FindMeshTemplate(ProjectileClass);
+	if (!World || !MeshTemplate || !MeshTemplate->GetStaticMesh() || !FApp::CanEverRender())
+		return nullptr;
+
+	if (!VisualsActor)
+	{
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.ObjectFlags |= RF_Transient;
+		VisualsActor = World->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, SpawnParams);
+	}
+
+	UInstancedStaticMeshComponent* Visuals = NewObject<UInstancedStaticMeshComponent>(VisualsActor);
+	Visuals->SetMobility(EComponentMobility::Movable);
+	Visuals->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Visuals->SetCanEverAffectNavigation(false);
+	Visuals->SetStaticMesh(MeshTemplate->GetStaticMesh());
+	for (int32 MaterialIndex = 0; MaterialIndex < MeshTemplate->GetNumMaterials(); ++MaterialIndex)
+	{
+		Visuals->SetMaterial(MaterialIndex, MeshTemplate->GetMaterial(MaterialIndex));
+	}
+
+	if (USceneComponent* Root = VisualsActor->GetRootComponent())
+		Visuals->SetupAttachment(Root);
+	else
+		VisualsActor->SetRootComponent(Visuals);
+
+	Visuals->RegisterComponent();
+	VisualsActor->AddInstanceComponent(Visuals);
+
+	OutMeshTransform = MeshTemplate->GetRelativeTransform();
+	return Visuals;
+}
+
+void UProjectileManagerSubsystem::UpdateVisuals()
+{
+	for (int32 TypeIndex = 0; TypeIndex < Types.Num(); ++TypeIndex)
+	{
+		UInstancedStaticMeshComponent* Visuals = Types[TypeIndex].Visuals;
+		if (!Visuals)
+			continue;
+
+		InstanceTransforms.Reset();
+		for (int32 Index = 0; Index < Positions.Num(); ++Index)
+		{
+			if (TypeIndices[Index] == TypeIndex)
+			{
+				// Same as bRotationFollowsVelocity on the projectile movement component
+				const FTransform BulletTransform(Velocities[Index].Rotation(), Positions[Index]);
+				InstanceTransforms.Add(Types[TypeIndex].MeshTransform * BulletTransform);
+			}
+		}
+
+		// Instances are only ever added or removed at the end, all of them are rewritten below anyway
+		while (Visuals->GetInstanceCount() < InstanceTransforms.Num())
+		{
+			Visuals->AddInstance(FTransform::Identity, true);
+		}
+		while (Visuals->GetInstanceCount() > InstanceTransforms.Num())
+		{
+			Visuals->RemoveInstance(Visuals->GetInstanceCount() - 1);
+		}
+
+		if (InstanceTransforms.Num() > 0)
+			Visuals->BatchUpdateInstancesTransforms(0, InstanceTransforms, true, true, true);
+	}
+}
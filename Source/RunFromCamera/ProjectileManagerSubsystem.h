@@ -0,0 +1,173 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "ProjectilePoolSubsystem.h"
+#include "Engine/NetSerialization.h"
+#include "ProjectileManagerSubsystem.generated.h"
+
+class AProjectile;
+class UInstancedStaticMeshComponent;
+
+/**
+ * Everything bullets of one projectile class and collision profile have in common.
+ */
+USTRUCT()
+struct FSimulatedProjectileType
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UClass* ProjectileClass = nullptr;
+
+	UPROPERTY()
+	FName CollisionProfileName;
+
+	// One instance per live bullet of this type, null when nothing can be rendered
+	UPROPERTY()
+	UInstancedStaticMeshComponent* Visuals = nullptr;
+
+	// Relative transform of the mesh inside the projectile Blueprint
+	FTransform MeshTransform;
+
+	ECollisionChannel CollisionChannel = ECC_WorldDynamic;
+
+	FCollisionResponseParams ResponseParams;
+
+	float Radius = 5.f;
+};
+
+/**
+ * One shot as it goes over the network. Bullets are never replicated actors: the shooter multicasts this and every
+ * machine flies the bullet itself, only the server's copy scores and kills. The shooter id is the actor the event
+ * is multicast on.
+ */
+USTRUCT()
+struct FProjectileFireEvent
+{
+	GENERATED_BODY()
+
+	// Where the bullet left the barrel, to the centimetre
+	UPROPERTY()
+	FVector_NetQuantize MuzzleLocation;
+
+	UPROPERTY()
+	FVector_NetQuantizeNormal Direction;
+
+	// Server world time of the shot, clients fast-forward the bullet by however late the event arrived
+	UPROPERTY()
+	float ServerTime = 0.f;
+
+	// Which of the shooter's presets the bullet uses, for the player 0 is first and 1 third person
+	UPROPERTY()
+	uint8 PresetIndex = 0;
+
+	bool NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess);
+};
+
+template<>
+struct TStructOpsTypeTraits<FProjectileFireEvent> : public TStructOpsTypeTraitsBase2<FProjectileFireEvent>
+{
+	enum
+	{
+		WithNetSerializer = true
+	};
+};
+
+/**
+ * Simulates bullets that don't need an actor of their own in structure-of-arrays form.
+ * All bullets are swept in one batched pass per frame and hits are resolved on the game thread
+ * with the same rules as AProjectile::OnHit.
+ */
+UCLASS()
+class RUNFROMCAMERA_API UProjectileManagerSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual TStatId GetStatId() const override;
+
+	// False when RunFromCamera.Projectiles.Simulate is off, shooters then fall back to pooled actors
+	bool IsSimulationEnabled() const;
+
+	// Adds a bullet flying along Direction at the preset's speed
+	void Launch(TSubclassOf<AProjectile> ProjectileClass, const FVector& Location, const FVector& Direction, const FProjectilePreset& Preset, AActor* Owner);
+
+	// Adds a bullet for a shot fired on another machine. Flies the pooled actor instead when simulation is off.
+	void LaunchFromFireEvent(TSubclassOf<AProjectile> ProjectileClass, const FProjectileFireEvent& FireEvent, const FProjectilePreset& Preset, AActor* Owner);
+
+	// Stamps a shot with the server time and a seed, ready to be sent
+	FProjectileFireEvent MakeFireEvent(const FVector& MuzzleLocation, const FVector& Direction, uint8 PresetIndex) const;
+
+	// Counts a fire event multicast by the server for the bandwidth report
+	void RecordFireEventSent(const FProjectileFireEvent& FireEvent);
+
+	// Logs fire event and total outgoing bandwidth per second, overall and per turret
+	void ReportBandwidth() const;
+
+	int32 GetNumProjectiles() const { return Positions.Num(); }
+
+	// Counts a shot for the shots per second counter, whether it was simulated or a pooled actor
+	void RecordShot() { ++ShotsThisSecond; }
+
+protected:
+	virtual bool DoesSupportWorldType(EWorldType::Type WorldType) const override;
+
+private:
+	uint8 FindOrAddType(UClass* ProjectileClass, FName CollisionProfileName);
+
+	UInstancedStaticMeshComponent* CreateVisuals(UClass* ProjectileClass, FTransform& OutMeshTransform);
+
+	void RemoveProjectile(int32 Index);
+
+	void UpdateVisuals();
+
+	// Live projectile and shots per second counters for stats, CSV and Insights
+	void PublishCounters();
+
+	UPROPERTY()
+	TArray<FSimulatedProjectileType> Types;
+
+	// Owns the instanced mesh components used to draw simulated bullets
+	UPROPERTY()
+	AActor* VisualsActor = nullptr;
+
+	TArray<FVector> Positions;
+
+	TArray<FVector> Velocities;
+
+	TArray<float> RemainingLife;
+
+	TArray<TWeakObjectPtr<AActor>> Owners;
+
+	TArray<uint8> TypeIndices;
+
+	TBitArray<> BounceFlags;
+
+	// Scratch buffers reused every frame by the sweep pass
+	TArray<FHitResult> SweepHits;
+
+	TArray<const AActor*> SweepOwners;
+
+	TArray<FTransform> InstanceTransforms;
+
+	int32 ShotsThisSecond = 0;
+
+	int32 ShotsPerSecond = 0;
+
+	float ShotCounterTime = 0.f;
+
+	int32 FireEventsThisSecond = 0;
+
+	int32 FireEventsPerSecond = 0;
+
+	int64 FireEventBitsThisSecond = 0;
+
+	int64 FireEventBitsPerSecond = 0;
+};
@@ -0,0 +1,171 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "ProjectilePoolSubsystem.h"
+#include "RunFromCamera.h"
+#include "Projectile.h"
+#include "BulletCamRig.h"
+#include "Engine/CollisionProfile.h"
+
+DECLARE_DWORD_COUNTER_STAT(TEXT("Projectile Pool Hits"), STAT_ProjectilePoolHits, STATGROUP_RunFromCamera);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Projectile Pool Misses"), STAT_ProjectilePoolMisses, STATGROUP_RunFromCamera);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Pooled Projectiles"), STAT_ProjectilePoolFree, STATGROUP_RunFromCamera);
+
+static TAutoConsoleVariable<int32> CVarProjectilePoolPrewarmCount(
+	TEXT("RunFromCamera.ProjectilePool.PrewarmCount"),
+	32,
+	TEXT("Number of inactive projectiles spawned up front for every projectile class and collision profile."),
+	ECVF_Default);
+
+void UProjectilePoolSubsystem::Deinitialize()
+{
+	UE_LOG(LogRunFromCamera, Log, TEXT("Projectile pool: %d hits, %d misses"), TotalHits, TotalMisses);
+
+	for (const FProjectilePoolBucket& Bucket : Buckets)
+	{
+		DEC_DWORD_STAT_BY(STAT_ProjectilePoolFree, Bucket.FreeProjectiles.Num());
+	}
+	Buckets.Empty();
+	ActiveProjectiles.Empty();
+	BulletCamRig = nullptr;
+
+	Super::Deinitialize();
+}
+
+bool UProjectilePoolSubsystem::DoesSupportWorldType(EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UProjectilePoolSubsystem::Prewarm(TSubclassOf<AProjectile> ProjectileClass, const FProjectilePreset& Preset, int32 Count)
+{
+	if (!ProjectileClass)
+		return;
+
+	if (Count < 0)
+		Count = CVarProjectilePoolPrewarmCount.GetValueOnGameThread();
+
+	FProjectilePoolBucket& Bucket = FindOrAddBucket(ProjectileClass, Preset.CollisionProfileName);
+	while (Bucket.FreeProjectiles.Num() < Count)
+	{
+		AProjectile* Projectile = SpawnPooledProjectile(ProjectileClass, Preset);
+		if (!Projectile)
+			break;
+
+		Bucket.FreeProjectiles.Add(Projectile);
+		INC_DWORD_STAT(STAT_ProjectilePoolFree);
+	}
+}
+
+AProjectile* UProjectilePoolSubsystem::Acquire(TSubclassOf<AProjectile> ProjectileClass, const FVector& Location, const FRotator& Rotation, const FProjectilePreset& Preset, AActor* Owner, APawn* Instigator)
+{
+	if (!ProjectileClass)
+		return nullptr;
+
+	FProjectilePoolBucket& Bucket = FindOrAddBucket(ProjectileClass, Preset.CollisionProfileName);
+
+	AProjectile* Projectile = nullptr;
+	while (!Projectile && Bucket.FreeProjectiles.Num() > 0)
+	{
+		// Level streaming or a Blueprint may have destroyed a pooled bullet behind our back
+		Projectile = Bucket.FreeProjectiles.Pop(false);
+		DEC_DWORD_STAT(STAT_ProjectilePoolFree);
+		if (!IsValid(Projectile))
+			Projectile = nullptr;
+	}
+
+	if (Projectile)
+	{
+		++TotalHits;
+		INC_DWORD_STAT(STAT_ProjectilePoolHits);
+	}
+	else
+	{
+		++TotalMisses;
+		INC_DWORD_STAT(STAT_ProjectilePoolMisses);
+		Projectile = SpawnPooledProjectile(ProjectileClass, Preset);
+		if (!Projectile)
+			return nullptr;
+	}
+
+	Projectile->SetOwner(Owner);
+	Projectile->SetInstigator(Instigator);
+	Projectile->SetActorLocationAndRotation(Location, Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+	Projectile->ActivateFromPool(Preset);
+	ActiveProjectiles.Add(Projectile);
+
+	return Projectile;
+}
+
+void UProjectilePoolSubsystem::Release(AProjectile* Projectile)
+{
+	if (!IsValid(Projectile) || Projectile->IsInPool())
+		return;
+
+	Projectile->DeactivateForPool();
+	ActiveProjectiles.RemoveSingleSwap(Projectile, false);
+
+	FProjectilePoolBucket& Bucket = FindOrAddBucket(Projectile->GetClass(), Projectile->CollisionComponent->GetCollisionProfileName());
+	Bucket.FreeProjectiles.Add(Projectile);
+	INC_DWORD_STAT(STAT_ProjectilePoolFree);
+}
+
+ABulletCamRig* UProjectilePoolSubsystem::GetBulletCamRig()
+{
+	if (!IsValid(BulletCamRig))
+	{
+		UWorld* World = GetWorld();
+		if (!World)
+			return nullptr;
+
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+		SpawnParams.ObjectFlags |= RF_Transient;
+		BulletCamRig = World->SpawnActor<ABulletCamRig>(ABulletCamRig::StaticClass(), FTransform::Identity, SpawnParams);
+	}
+	return BulletCamRig;
+}
+
+FProjectilePoolBucket& UProjectilePoolSubsystem::FindOrAddBucket(UClass* ProjectileClass, FName CollisionProfileName)
+{
+	// Presets saved before a profile was renamed still say the old name, while a released bullet reports the new one
+	FCollisionResponseTemplate ProfileTemplate;
+	if (UCollisionProfile::Get()->GetProfileTemplate(CollisionProfileName, ProfileTemplate))
+		CollisionProfileName = ProfileTemplate.Name;
+
+	// Only a handful of class/profile combinations exist, a linear search beats hashing here
+	for (FProjectilePoolBucket& Bucket : Buckets)
+	{
+		if (Bucket.ProjectileClass == ProjectileClass && Bucket.CollisionProfileName == CollisionProfileName)
+			return Bucket;
+	}
+
+	FProjectilePoolBucket& Bucket = Buckets.AddDefaulted_GetRef();
+	Bucket.ProjectileClass = ProjectileClass;
+	Bucket.CollisionProfileName = CollisionProfileName;
+	return Bucket;
+}
+
+AProjectile* UProjectilePoolSubsystem::SpawnPooledProjectile(UClass* ProjectileClass, const FProjectilePreset& Preset)
+{
+	UWorld* World = GetWorld();
+	if (!World)
+		return nullptr;
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	AProjectile* Projectile = World->SpawnActor<AProjectile>(ProjectileClass, FVector::ZeroVector, FRotator::ZeroRotator, SpawnParams);
+	if (!Projectile)
+	{
+		UE_LOG(LogRunFromCamera, Warning, TEXT("Projectile pool failed to spawn %s"), *GetNameSafe(ProjectileClass));
+		return nullptr;
+	}
+
+	// The profile is set once for the lifetime of the bullet, which is why buckets are keyed by it
+	Projectile->CollisionComponent->SetCollisionProfileName(Preset.CollisionProfileName);
+	Projectile->MarkPooled();
+	Projectile->DeactivateForPool();
+
+	return Projectile;
+}
@@ -0,0 +1,103 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "ProjectilePoolSubsystem.generated.h"
+
+class AProjectile;
+class ABulletCamRig;
+
+/**
+ * Per-shooter settings applied to a projectile when it is handed out by the pool.
+ */
+USTRUCT(BlueprintType)
+struct FProjectilePreset
+{
+	GENERATED_BODY()
+
+	/** Pooled projectiles are bucketed by profile, so a reused bullet never has its physics filter rebuilt.
+	 *  PlayerProjectile or TurretProjectile, picked by the shooter so bullets of one team never test against each other. */
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Projectile")
+	FName CollisionProfileName = TEXT("PlayerProjectile");
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Projectile")
+	bool bShouldBounce = false;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Projectile")
+	float InitialSpeed = 3000.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Projectile")
+	float MaxSpeed = 3000.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Projectile")
+	float LifeSpan = 3.f;
+};
+
+USTRUCT()
+struct FProjectilePoolBucket
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	UClass* ProjectileClass = nullptr;
+
+	UPROPERTY()
+	FName CollisionProfileName;
+
+	UPROPERTY()
+	TArray<AProjectile*> FreeProjectiles;
+};
+
+/**
+ * Keeps inactive AProjectile instances around so shooters don't pay for SpawnActor/Destroy on every shot.
+ */
+UCLASS()
+class RUNFROMCAMERA_API UProjectilePoolSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	// Spawns inactive projectiles until the bucket for this class and preset holds at least Count of them.
+	// A negative Count uses RunFromCamera.ProjectilePool.PrewarmCount.
+	void Prewarm(TSubclassOf<AProjectile> ProjectileClass, const FProjectilePreset& Preset, int32 Count = -1);
+
+	// Hands out a pooled projectile (spawning one on a miss) placed at the muzzle and set up from Preset.
+	// The caller still launches it with FireInDirection.
+	AProjectile* Acquire(TSubclassOf<AProjectile> ProjectileClass, const FVector& Location, const FRotator& Rotation, const FProjectilePreset& Preset, AActor* Owner, APawn* Instigator);
+
+	// Puts the projectile back into its bucket instead of destroying it
+	void Release(AProjectile* Projectile);
+
+	// Projectiles handed out by Acquire and not released yet
+	const TArray<AProjectile*>& GetActiveProjectiles() const { return ActiveProjectiles; }
+
+	int32 GetNumActiveProjectiles() const { return ActiveProjectiles.Num(); }
+
+	// The single bullet cam rig of this world, spawned the first time bullet cam is used
+	ABulletCamRig* GetBulletCamRig();
+
+protected:
+	virtual bool DoesSupportWorldType(EWorldType::Type WorldType) const override;
+
+private:
+	FProjectilePoolBucket& FindOrAddBucket(UClass* ProjectileClass, FName CollisionProfileName);
+
+	AProjectile* SpawnPooledProjectile(UClass* ProjectileClass, const FProjectilePreset& Preset);
+
+	UPROPERTY()
+	TArray<FProjectilePoolBucket> Buckets;
+
+	UPROPERTY()
+	ABulletCamRig* BulletCamRig = nullptr;
+
+	UPROPERTY()
+	TArray<AProjectile*> ActiveProjectiles;
+
+	int32 TotalHits = 0;
+
+	int32 TotalMisses = 0;
+};
@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "RicochetSolver.h"
+#include "RunFromCamera.h"
+#include "Engine/World.h"
+
+DEFINE_STAT(STAT_TrajectoryPredictions);
+
+DECLARE_CYCLE_STAT(TEXT("Ricochet Solver"), STAT_RicochetSolver, STATGROUP_RunFromCamera);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Ricochet Solver Sweeps"), STAT_RicochetSolverSweeps, STATGROUP_RunFromCamera);
+
+bool FRicochetSolver::Solve(const UWorld* World, const FRicochetSolverParams& Params, FRicochetPath& OutPath)
+{
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_RicochetSolver);
+
+	OutPath.Reset();
+	if (!World)
+		return false;
+
+	INC_DWORD_STAT(STAT_TrajectoryPredictions);
+	CSV_CUSTOM_STAT(RunFromCamera, TrajectoryPredictions, 1, ECsvCustomStatOp::Accumulate);
+
+	const FCollisionShape Sphere = FCollisionShape::MakeSphere(Params.ProjectileRadius);
+
+	FVector Start = Params.StartLocation;
+	FVector Direction = Params.Direction.GetSafeNormal();
+	float RemainingDistance = Params.MaxDistance;
+	const AActor* PreviousHitActor = nullptr;
+
+	OutPath.Points.Add(Start);
+
+	for (int32 Bounce = 0; ; ++Bounce)
+	{
+		const FVector End = Start + Direction * RemainingDistance;
+
+		// Ignoring what we just bounced off saves the sweep from starting in contact with it
+		FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(RicochetSolver), false, Params.IgnoredActor);
+		QueryParams.AddIgnoredActor(PreviousHitActor);
+
+		FHitResult Hit;
+		World->SweepSingleByChannel(Hit, Start, End, FQuat::Identity, Params.TraceChannel, Sphere, QueryParams);
+		INC_DWORD_STAT(STAT_RicochetSolverSweeps);
+
+		if (!Hit.bBlockingHit)
+		{
+			OutPath.Points.Add(End);
+			OutPath.HitActors.Add(nullptr);
+			return false;
+		}
+
+		OutPath.HitActors.Add(Hit.GetActor());
+		RemainingDistance -= Hit.Distance;
+
+		if (Bounce >= Params.MaxBounces || RemainingDistance <= 0.f)
+		{
+			OutPath.Points.Add(Hit.ImpactPoint);
+			OutPath.LastHit = Hit;
+			return true;
+		}
+
+		Reflect(Hit, Direction, Params.ProjectileRadius, Start, Direction);
+		OutPath.Points.Add(Start);
+		PreviousHitActor = Hit.GetActor();
+	}
+}
+
+void FRicochetSolver::Reflect(const FHitResult& Hit, const FVector& Direction, float ProjectileRadius, FVector& OutStart, FVector& OutDirection)
+{
+	OutStart = Hit.ImpactPoint + Hit.ImpactNormal * (ProjectileRadius * 2.f);
+	OutDirection = FMath::GetReflectionVector(Direction, Hit.ImpactNormal);
+}
@@ -0,0 +1,72 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineTypes.h"
+#include "RunFromCamera.h"
+
+// Ricochet paths computed this frame, sync or async
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Trajectory Predictions"), STAT_TrajectoryPredictions, STATGROUP_RunFromCamera, RUNFROMCAMERA_API);
+
+/**
+ * Input of FRicochetSolver. Our bullets fly without gravity, so every segment of the path is a straight line.
+ */
+struct FRicochetSolverParams
+{
+	FVector StartLocation = FVector::ZeroVector;
+
+	FVector Direction = FVector::ForwardVector;
+
+	float ProjectileRadius = 5.f;
+
+	ECollisionChannel TraceChannel = ECC_ProjectileTrace;
+
+	// Number of ricochets after the first impact, 0 stops at the first thing hit
+	int32 MaxBounces = 2;
+
+	// Length of the whole path, summed over all segments
+	float MaxDistance = 9000.f;
+
+	// Usually the shooter, ignored by every segment
+	const AActor* IgnoredActor = nullptr;
+};
+
+/**
+ * Result of FRicochetSolver.
+ */
+struct FRicochetPath
+{
+	// Start of every segment followed by the end of the last one
+	TArray<FVector, TInlineAllocator<8>> Points;
+
+	// Actor each segment ended on, null when the segment hit nothing
+	TArray<TWeakObjectPtr<AActor>, TInlineAllocator<8>> HitActors;
+
+	// Impact that ended the last segment, if any
+	FHitResult LastHit;
+
+	void Reset()
+	{
+		Points.Reset();
+		HitActors.Reset();
+		LastHit.Reset(1.f, false);
+	}
+
+	int32 GetNumSegments() const { return HitActors.Num(); }
+
+	bool EndsInBlockingHit() const { return LastHit.bBlockingHit; }
+};
+
+/**
+ * Straight-line ricochet prediction: one sphere sweep per segment, reflected across the impact normal.
+ */
+struct RUNFROMCAMERA_API FRicochetSolver
+{
+	// Fills OutPath and returns true when the path ends on a blocking hit within MaxDistance
+	static bool Solve(const UWorld* World, const FRicochetSolverParams& Params, FRicochetPath& OutPath);
+
+	// Where and in which direction the segment after Hit starts. The start is pushed off the surface by the
+	// projectile's diameter so the next sweep doesn't begin inside the wall it just bounced off.
+	static void Reflect(const FHitResult& Hit, const FVector& Direction, float ProjectileRadius, FVector& OutStart, FVector& OutDirection);
+};
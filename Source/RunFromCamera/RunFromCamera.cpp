@@ -3,5 +3,10 @@
 #include "RunFromCamera.h"
 #include "Modules/ModuleManager.h"
 
+DEFINE_LOG_CATEGORY(LogRunFromCamera);
+
+UE_TRACE_CHANNEL_DEFINE(RunFromCameraChannel);
+
+CSV_DEFINE_CATEGORY_MODULE(RUNFROMCAMERA_API, RunFromCamera, true);
+
 IMPLEMENT_PRIMARY_GAME_MODULE( FDefaultGameModuleImpl, RunFromCamera, "RunFromCamera" );
- 
\ No newline at end of file
@@ -3,3 +3,29 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Stats/Stats.h"
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "Trace/Trace.h"
+
+DECLARE_LOG_CATEGORY_EXTERN(LogRunFromCamera, Log, All);
+
+DECLARE_STATS_GROUP(TEXT("RunFromCamera"), STATGROUP_RunFromCamera, STATCAT_Advanced);
+
+// Enable with -trace=cpu,RunFromCamera to see our scopes in Insights
+UE_TRACE_CHANNEL_EXTERN(RunFromCameraChannel, RUNFROMCAMERA_API);
+
+CSV_DECLARE_CATEGORY_MODULE_EXTERN(RUNFROMCAMERA_API, RunFromCamera);
+
+// Collision channels set up in DefaultEngine.ini, bullets of one team never test against bullets of any team
+#define ECC_PlayerProjectile ECC_GameTraceChannel1
+#define ECC_TurretProjectile ECC_GameTraceChannel2
+// Trajectory prediction, blocked by whatever a player bullet would hit except other bullets
+#define ECC_ProjectileTrace ECC_GameTraceChannel3
+
+// Times the enclosing scope for stat RunFromCamera, Insights and the CSV profiler at once.
+// Stat has to be declared with DECLARE_CYCLE_STAT in STATGROUP_RunFromCamera.
+#define RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(Stat) \
+	SCOPE_CYCLE_COUNTER(Stat); \
+	TRACE_CPUPROFILER_EVENT_SCOPE_ON_CHANNEL(Stat, RunFromCameraChannel); \
+	CSV_SCOPED_TIMING_STAT(RunFromCamera, Stat)
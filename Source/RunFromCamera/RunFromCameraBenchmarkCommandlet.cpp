@@ -0,0 +1,301 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "RunFromCameraBenchmarkCommandlet.h"
+#include "RunFromCamera.h"
+#include "RunFromCameraCharacter.h"
+#include "Pacificator.h"
+#include "Projectile.h"
+#include "ProjectileManagerSubsystem.h"
+#include "GameFramework/PlayerController.h"
+#include "Engine/Engine.h"
+#include "Engine/StaticMesh.h"
+#include "Engine/StaticMeshActor.h"
+#include "Engine/World.h"
+#include "EngineUtils.h"
+#include "HAL/PlatformMemory.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+
+namespace
+{
+	const TCHAR* DefaultPacificatorClass = TEXT("/Game/PacificatorCamera/Pacificator_BP.Pacificator_BP_C");
+	const TCHAR* DefaultPlayerClass = TEXT("/Game/ThirdPerson/Blueprints/BP_ThirdPersonCharacter.BP_ThirdPersonCharacter_C");
+
+	const float WallHeight = 600.f;
+
+	// The engine cube is 100 units on every side
+	const float CubeSize = 100.f;
+
+	AStaticMeshActor* SpawnBlock(UWorld* World, UStaticMesh* Cube, const FVector& Location, const FVector& Size)
+	{
+		FActorSpawnParameters SpawnParams;
+		SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+		AStaticMeshActor* Block = World->SpawnActor<AStaticMeshActor>(Location, FRotator::ZeroRotator, SpawnParams);
+		if (Block)
+		{
+			// Static components refuse a new mesh once registered
+			Block->SetMobility(EComponentMobility::Movable);
+			Block->GetStaticMeshComponent()->SetStaticMesh(Cube);
+			Block->SetActorScale3D(Size / CubeSize);
+		}
+		return Block;
+	}
+}
+
+URunFromCameraBenchmarkCommandlet::URunFromCameraBenchmarkCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = true;
+	LogToConsole = true;
+}
+
+int32 URunFromCameraBenchmarkCommandlet::Main(const FString& Params)
+{
+	int32 NumTurrets = 100;
+	float Seconds = 60.f;
+	float FPS = 60.f;
+	int32 Seed = 1;
+	float Spacing = 800.f;
+	FString PacificatorClassPath = DefaultPacificatorClass;
+	FString PlayerClassPath = DefaultPlayerClass;
+	FString OutputPath;
+
+	FParse::Value(*Params, TEXT("Turrets="), NumTurrets);
+	FParse::Value(*Params, TEXT("Seconds="), Seconds);
+	FParse::Value(*Params, TEXT("FPS="), FPS);
+	FParse::Value(*Params, TEXT("Seed="), Seed);
+	FParse::Value(*Params, TEXT("Spacing="), Spacing);
+	FParse::Value(*Params, TEXT("PacificatorClass="), PacificatorClassPath);
+	FParse::Value(*Params, TEXT("PlayerClass="), PlayerClassPath);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+
+	if (OutputPath.IsEmpty())
+	{
+		OutputPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / FString::Printf(TEXT("Benchmark-%dTurrets-%s.csv"), NumTurrets, *FDateTime::Now().ToString());
+	}
+
+	UClass* PacificatorClass = LoadClass<APacificator>(nullptr, *PacificatorClassPath);
+	UClass* PlayerClass = LoadClass<ARunFromCameraCharacter>(nullptr, *PlayerClassPath);
+	if (!PacificatorClass || !PlayerClass)
+	{
+		UE_LOG(LogRunFromCamera, Error, TEXT("Benchmark could not load %s or %s"), *PacificatorClassPath, *PlayerClassPath);
+		return 1;
+	}
+
+	// Gameplay draws from the global random stream, seeding it makes two runs of the same scenario comparable
+	FMath::RandInit(Seed);
+	FMath::SRandInit(Seed);
+
+	UWorld* World = UWorld::CreateWorld(EWorldType::Game, false, TEXT("RunFromCameraBenchmark"));
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+
+	const FDelegateHandle SpawnedHandle = World->AddOnActorSpawnedHandler(FOnActorSpawned::FDelegate::CreateUObject(this, &URunFromCameraBenchmarkCommandlet::HandleActorSpawned));
+
+	FURL URL;
+	World->SetGameMode(URL);
+	World->InitializeActorsForPlay(URL);
+
+	// Turrets sit on a square grid, the arena leaves room for the player to strafe around them
+	const int32 TurretsPerRow = FMath::Max(FMath::CeilToInt(FMath::Sqrt((float)NumTurrets)), 1);
+	const float HalfExtent = TurretsPerRow * Spacing * 0.5f + 2000.f;
+	BuildArena(World, HalfExtent);
+	const int32 NumSpawnedTurrets = SpawnPacificators(World, PacificatorClass, NumTurrets, Spacing);
+
+	FActorSpawnParameters PlayerSpawnParams;
+	PlayerSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+	const FVector PlayerStart(-HalfExtent + 1000.f, 0.f, 200.f);
+	ARunFromCameraCharacter* Player = World->SpawnActor<ARunFromCameraCharacter>(PlayerClass, PlayerStart, FRotator::ZeroRotator, PlayerSpawnParams);
+
+	// A player controller like the replay's, so points, death and the bullet cam find player controller 0
+	APlayerController* PlayerController = World->SpawnActor<APlayerController>();
+	if (!Player || !PlayerController)
+	{
+		UE_LOG(LogRunFromCamera, Error, TEXT("Benchmark could not spawn the player"));
+		World->RemoveOnActorSpawnedHandler(SpawnedHandle);
+		GEngine->DestroyWorldContext(World);
+		World->DestroyWorld(false);
+		return 1;
+	}
+	PlayerController->Possess(Player);
+
+	World->BeginPlay();
+
+	UE_LOG(LogRunFromCamera, Display, TEXT("Benchmark: %d turrets, %.0f s at %.0f FPS, seed %d"), NumSpawnedTurrets, Seconds, FPS, Seed);
+
+	const float DeltaSeconds = 1.f / FMath::Max(FPS, 1.f);
+	const int32 NumFrames = FMath::CeilToInt(Seconds * FPS);
+
+	FString Csv = TEXT("Frame,Time,GameThreadMs,TickingActors,SimulatedProjectiles,ProjectileActors,Spawned,Destroyed,UsedPhysicalMB,Camera\n");
+	TArray<double> FrameTimes;
+	FrameTimes.Reserve(NumFrames);
+
+	UProjectileManagerSubsystem* ProjectileManager = World->GetSubsystem<UProjectileManagerSubsystem>();
+
+	for (int32 Frame = 0; Frame < NumFrames; ++Frame)
+	{
+		const float Time = Frame * DeltaSeconds;
+		FrameSpawnCount = 0;
+		FrameDestroyCount = 0;
+
+		FApp::SetDeltaTime(DeltaSeconds);
+		FApp::SetCurrentTime(FApp::GetCurrentTime() + DeltaSeconds);
+		++GFrameCounter;
+
+		const double StartTime = FPlatformTime::Seconds();
+		UpdatePlayerScript(Player, PlayerController, Time, DeltaSeconds);
+		World->Tick(LEVELTICK_All, DeltaSeconds);
+		const double GameThreadMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+		FrameTimes.Add(GameThreadMs);
+
+		// Counting happens outside the timed section
+		int32 NumTickingActors = 0;
+		int32 NumProjectileActors = 0;
+		for (TActorIterator<AActor> It(World); It; ++It)
+		{
+			if (It->IsActorTickEnabled())
+				++NumTickingActors;
+
+			const AProjectile* Projectile = Cast<AProjectile>(*It);
+			if (Projectile && !Projectile->IsInPool())
+				++NumProjectileActors;
+		}
+
+		const int32 NumSimulatedProjectiles = ProjectileManager ? ProjectileManager->GetNumProjectiles() : 0;
+		const float UsedPhysicalMB = FPlatformMemory::GetStats().UsedPhysical / (1024.f * 1024.f);
+
+		Csv += FString::Printf(TEXT("%d,%.4f,%.4f,%d,%d,%d,%d,%d,%.1f,%s\n"), Frame, Time, GameThreadMs, NumTickingActors, NumSimulatedProjectiles,
+			NumProjectileActors, FrameSpawnCount, FrameDestroyCount, UsedPhysicalMB, *UEnum::GetValueAsString(Player->GetCurrentCamera()));
+	}
+
+	World->RemoveOnActorSpawnedHandler(SpawnedHandle);
+
+	if (FFileHelper::SaveStringToFile(Csv, *OutputPath))
+	{
+		UE_LOG(LogRunFromCamera, Display, TEXT("Benchmark written to %s"), *FPaths::ConvertRelativePathToFull(OutputPath));
+	}
+	else
+	{
+		UE_LOG(LogRunFromCamera, Error, TEXT("Benchmark could not write %s"), *OutputPath);
+	}
+
+	if (FrameTimes.Num() > 0)
+	{
+		double Total = 0.0;
+		for (double FrameTime : FrameTimes)
+			Total += FrameTime;
+
+		FrameTimes.Sort();
+		const double P95 = FrameTimes[FMath::Min(FMath::FloorToInt(FrameTimes.Num() * 0.95f), FrameTimes.Num() - 1)];
+		UE_LOG(LogRunFromCamera, Display, TEXT("Benchmark game thread: avg %.3f ms, p95 %.3f ms, max %.3f ms over %d frames"),
+			Total / FrameTimes.Num(), P95, FrameTimes.Last(), FrameTimes.Num());
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+
+	return 0;
+}
+
+void URunFromCameraBenchmarkCommandlet::BuildArena(UWorld* World, float HalfExtent)
+{
+	UStaticMesh* Cube = LoadObject<UStaticMesh>(nullptr, TEXT("/Engine/BasicShapes/Cube.Cube"));
+	if (!Cube)
+	{
+		UE_LOG(LogRunFromCamera, Warning, TEXT("Benchmark arena has no cube mesh, bullets will fly into the void"));
+		return;
+	}
+
+	const float Size = HalfExtent * 2.f;
+	SpawnBlock(World, Cube, FVector(0.f, 0.f, -CubeSize * 0.5f), FVector(Size, Size, CubeSize));
+
+	SpawnBlock(World, Cube, FVector(HalfExtent, 0.f, WallHeight * 0.5f), FVector(CubeSize, Size, WallHeight));
+	SpawnBlock(World, Cube, FVector(-HalfExtent, 0.f, WallHeight * 0.5f), FVector(CubeSize, Size, WallHeight));
+	SpawnBlock(World, Cube, FVector(0.f, HalfExtent, WallHeight * 0.5f), FVector(Size, CubeSize, WallHeight));
+	SpawnBlock(World, Cube, FVector(0.f, -HalfExtent, WallHeight * 0.5f), FVector(Size, CubeSize, WallHeight));
+
+	// Pillars in the player's lane give the ricochet preview something to bounce off
+	for (int32 Pillar = -2; Pillar <= 2; ++Pillar)
+	{
+		SpawnBlock(World, Cube, FVector(-HalfExtent + 1800.f, Pillar * 1500.f, WallHeight * 0.5f), FVector(200.f, 200.f, WallHeight));
+	}
+}
+
+int32 URunFromCameraBenchmarkCommandlet::SpawnPacificators(UWorld* World, UClass* PacificatorClass, int32 Count, float Spacing)
+{
+	const int32 TurretsPerRow = FMath::Max(FMath::CeilToInt(FMath::Sqrt((float)Count)), 1);
+	const float GridOffset = (TurretsPerRow - 1) * Spacing * 0.5f;
+
+	FActorSpawnParameters SpawnParams;
+	SpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AlwaysSpawn;
+
+	int32 NumSpawned = 0;
+	for (int32 Index = 0; Index < Count; ++Index)
+	{
+		const FVector Location((Index % TurretsPerRow) * Spacing - GridOffset, (Index / TurretsPerRow) * Spacing - GridOffset, 300.f);
+		APacificator* Pacificator = World->SpawnActor<APacificator>(PacificatorClass, Location, FRotator(0.f, FMath::FRandRange(0.f, 360.f), 0.f), SpawnParams);
+		if (!Pacificator)
+			continue;
+
+		// Only placed turrets are possessed automatically
+		if (!Pacificator->GetController())
+			Pacificator->SpawnDefaultController();
+
+		++NumSpawned;
+	}
+	return NumSpawned;
+}
+
+void URunFromCameraBenchmarkCommandlet::UpdatePlayerScript(ARunFromCameraCharacter* Player, APlayerController* PlayerController, float Time, float DeltaSeconds)
+{
+	// Sweep the aim around the arena so turrets keep entering and leaving view
+	PlayerController->SetControlRotation(FRotator(-5.f, FRotator::NormalizeAxis(Time * 45.f), 0.f));
+
+	// Strafe left and right, two seconds each way
+	Player->MoveRight(FMath::Fmod(Time, 4.f) < 2.f ? 1.f : -1.f);
+	Player->MoveForward(0.25f);
+
+	// Sprint for three seconds out of every six
+	const bool bSprint = FMath::Fmod(Time, 6.f) < 3.f;
+	if (bSprint != bWasSprinting)
+	{
+		if (bSprint)
+			Player->StartSprint();
+		else
+			Player->StopSprint();
+		bWasSprinting = bSprint;
+	}
+
+	// Hold fire for half a second, which shows the ricochet preview in third person, then release to shoot
+	const bool bFire = FMath::Fmod(Time, 1.f) < 0.5f;
+	if (bFire != bWasFiring)
+	{
+		if (bFire)
+			Player->LeftMouseButtonDown();
+		else
+			Player->Fire();
+		bWasFiring = bFire;
+	}
+
+	// Alternate between third and first person every ten seconds
+	const int32 CameraSwitch = FMath::FloorToInt(Time / 10.f);
+	if (CameraSwitch != LastCameraSwitch && Player->GetCurrentCamera() != ECameraType::BulletCam)
+	{
+		Player->ChangePOV();
+		LastCameraSwitch = CameraSwitch;
+	}
+}
+
+void URunFromCameraBenchmarkCommandlet::HandleActorSpawned(AActor* Actor)
+{
+	++FrameSpawnCount;
+	Actor->OnDestroyed.AddDynamic(this, &URunFromCameraBenchmarkCommandlet::HandleActorDestroyed);
+}
+
+void URunFromCameraBenchmarkCommandlet::HandleActorDestroyed(AActor* Actor)
+{
+	++FrameDestroyCount;
+}
@@ -0,0 +1,54 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "RunFromCameraBenchmarkCommandlet.generated.h"
+
+class APlayerController;
+class ARunFromCameraCharacter;
+
+/**
+ * Headless benchmark. Builds an arena of walls, fills it with Pacificators and lets a scripted player strafe,
+ * sprint and shoot in both camera modes for a fixed number of frames at a fixed time step, writing one CSV row
+ * per frame to Saved/Benchmarks.
+ *
+ * UnrealEditor-Cmd RunFromCamera.uproject -run=RunFromCameraBenchmark -nullrhi -unattended -Turrets=500 -Seconds=60
+ *
+ * Optional: -FPS=60 -Seed=1 -Spacing=800 -Output=<file> -PacificatorClass=<path> -PlayerClass=<path>
+ */
+UCLASS()
+class URunFromCameraBenchmarkCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	URunFromCameraBenchmarkCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	// Floor, outer walls and a few pillars for the third person shots to ricochet off
+	void BuildArena(UWorld* World, float HalfExtent);
+
+	int32 SpawnPacificators(UWorld* World, UClass* PacificatorClass, int32 Count, float Spacing);
+
+	// Drives the player the way the input bindings would, deterministically from Time
+	void UpdatePlayerScript(ARunFromCameraCharacter* Player, APlayerController* PlayerController, float Time, float DeltaSeconds);
+
+	void HandleActorSpawned(AActor* Actor);
+
+	UFUNCTION()
+	void HandleActorDestroyed(AActor* Actor);
+
+	int32 FrameSpawnCount = 0;
+
+	int32 FrameDestroyCount = 0;
+
+	bool bWasFiring = false;
+
+	bool bWasSprinting = false;
+
+	int32 LastCameraSwitch = 0;
+};
@@ -1,22 +1,89 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "RunFromCameraCharacter.h"
+#include "RunFromCamera.h"
 #include "Camera/CameraComponent.h"
 #include "Components/CapsuleComponent.h"
 #include "Components/InputComponent.h"
+#include "Components/SkeletalMeshComponent.h"
 #include "GameFramework/CharacterMovementComponent.h"
 #include "GameFramework/Controller.h"
 #include "GameFramework/SpringArmComponent.h"
 #include "Projectile.h"
+#include "ProjectileManagerSubsystem.h"
+#include "BulletCamRig.h"
+#include "BulletCamFocusSubsystem.h"
+#include "RicochetSolver.h"
+#include "TrajectoryPreviewComponent.h"
 #include "Kismet/GameplayStatics.h"
 #include "Kismet/KismetMathLibrary.h"
 #include "Pacificator.h"
+#include "Net/UnrealNetwork.h"
+#include "TimerManager.h"
+
+DECLARE_CYCLE_STAT(TEXT("Character Fire"), STAT_CharacterFire, STATGROUP_RunFromCamera);
+DECLARE_CYCLE_STAT(TEXT("CheckBounces"), STAT_CheckBounces, STATGROUP_RunFromCamera);
+DECLARE_CYCLE_STAT(TEXT("CheckHitForBulletCam"), STAT_CheckHitForBulletCam, STATGROUP_RunFromCamera);
+DECLARE_CYCLE_STAT(TEXT("Bounce Preview (Sync)"), STAT_BouncePreviewSync, STATGROUP_RunFromCamera);
+DECLARE_CYCLE_STAT(TEXT("Bounce Preview (Async)"), STAT_BouncePreviewAsync, STATGROUP_RunFromCamera);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Bounce Preview Async Sweeps"), STAT_BouncePreviewAsyncSweeps, STATGROUP_RunFromCamera);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Bounce Path Cache Hits"), STAT_BouncePathCacheHits, STATGROUP_RunFromCamera);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Bounce Path Cache Misses"), STAT_BouncePathCacheMisses, STATGROUP_RunFromCamera);
+
+static TAutoConsoleVariable<bool> CVarAsyncBouncePreview(
+	TEXT("RunFromCamera.BouncePreview.Async"),
+	true,
+	TEXT("Build the third person ricochet preview from async sweeps instead of running the ricochet solver on the game thread."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarBouncePathCache(
+	TEXT("RunFromCamera.BouncePreview.Cache"),
+	true,
+	TEXT("Keep drawing the last ricochet path while the aim stays within tolerance and the path is still clear."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarBouncePathCachePositionTolerance(
+	TEXT("RunFromCamera.BouncePreview.CachePositionTolerance"),
+	2.f,
+	TEXT("How far in cm the muzzle may move before the cached ricochet path is recomputed."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<float> CVarBouncePathCacheAngleTolerance(
+	TEXT("RunFromCamera.BouncePreview.CacheAngleTolerance"),
+	0.25f,
+	TEXT("How far in degrees the aim may turn before the cached ricochet path is recomputed."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<int32> CVarBouncePreviewMaxBounces(
+	TEXT("RunFromCamera.BouncePreview.MaxBounces"),
+	2,
+	TEXT("Number of ricochets shown by the third person preview. The path is only drawn if it ricochets this often."),
+	ECVF_Default);
+
+static TAutoConsoleVariable<bool> CVarCaptureBulletCam(
+	TEXT("RunFromCamera.Profiling.CaptureBulletCam"),
+	true,
+	TEXT("Record a CSV profile of every bullet cam slow motion sequence (needs a build with the CSV profiler)."),
+	ECVF_Default);
+
+namespace
+{
+	// Matches the collision sphere of the projectile
+	const float BouncePreviewRadius = 5.f;
+
+	// How far from the character the server accepts a shot to start, the muzzle is 100 units out plus room for lag
+	const float MaxFireEventMuzzleDistance = 600.f;
+}
 
 //////////////////////////////////////////////////////////////////////////
 // ARunFromCameraCharacter
 
 ARunFromCameraCharacter::ARunFromCameraCharacter()
 {
+	// Only ticks while the bounce preview is up, see UpdateTickState
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.bStartWithTickEnabled = false;
+
 	// Set size for collision capsule
 	GetCapsuleComponent()->InitCapsuleSize(42.f, 96.0f);
 
@@ -60,6 +127,10 @@ ARunFromCameraCharacter::ARunFromCameraCharacter()
 	FirstPersonCamera->SetRelativeLocation({ 0.f, 10.f, 0.f});
 	FirstPersonCamera->bUsePawnControlRotation = true;
 
+	// Ricochet path shown while aiming in third person, drawn in world space
+	TrajectoryPreview = CreateDefaultSubobject<UTrajectoryPreviewComponent>(TEXT("TrajectoryPreview"));
+	TrajectoryPreview->SetupAttachment(RootComponent);
+
 	CurrentCamera = ECameraType::ThirdPerson;
 	bIsZoomed = false;
 	DefaultCameraFieldOfView = 90.f;
@@ -77,6 +148,57 @@ ARunFromCameraCharacter::ARunFromCameraCharacter()
 
 	Points = 0;
 	TimeDilationManipulator = .10f;
+
+	ThirdPersonProjectilePreset.bShouldBounce = true;
+}
+
+void ARunFromCameraCharacter::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if ( UProjectilePoolSubsystem* Pool = GetWorld()->GetSubsystem<UProjectilePoolSubsystem>() )
+	{
+		// Both presets share the "PlayerProjectile" profile and therefore the same bucket
+		Pool->Prewarm(ProjectileClass, FirstPersonProjectilePreset);
+	}
+
+	SessionRecording = GetWorld()->GetSubsystem<USessionRecordingSubsystem>();
+
+	// Turrets look for characters, not for player controllers, so AI driven players like the benchmark's are seen too
+	if ( UPacificatorSubsystem* PacificatorSubsystem = GetWorld()->GetSubsystem<UPacificatorSubsystem>() )
+	{
+		PacificatorSubsystem->RegisterSightTarget(this);
+	}
+
+	// Nobody looks through the cameras or at the mesh on a dedicated server. Aim comes from the eyes view point,
+	// so neither the boom's collision sweep nor the skeletal pose feed into the simulation.
+	if ( !FApp::CanEverRender() )
+	{
+		CameraBoom->SetComponentTickEnabled(false);
+		GetMesh()->VisibilityBasedAnimTickOption = EVisibilityBasedAnimTickOption::OnlyTickMontagesWhenNotRendered;
+	}
+
+	bBlueprintTicks = GetClass()->IsFunctionImplementedInScript(GET_FUNCTION_NAME_CHECKED(ARunFromCameraCharacter, ReceiveTick));
+	UpdateTickState();
+	UpdateStaminaRate();
+}
+
+void ARunFromCameraCharacter::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if ( UPacificatorSubsystem* PacificatorSubsystem = GetWorld()->GetSubsystem<UPacificatorSubsystem>() )
+	{
+		PacificatorSubsystem->UnregisterSightTarget(this);
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ARunFromCameraCharacter::RecordSessionEvent(ESessionRecordType Type, int32 Value)
+{
+	if ( SessionRecording )
+	{
+		SessionRecording->Record(Type, Value);
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////
@@ -114,6 +236,18 @@ void ARunFromCameraCharacter::SetupPlayerInputComponent(class UInputComponent* P
 	PlayerInputComponent->BindTouch(IE_Released, this, &ARunFromCameraCharacter::TouchStopped);
 }
 
+void ARunFromCameraCharacter::Jump()
+{
+	RecordSessionEvent(ESessionRecordType::Jump);
+	Super::Jump();
+}
+
+void ARunFromCameraCharacter::StopJumping()
+{
+	RecordSessionEvent(ESessionRecordType::StopJumping);
+	Super::StopJumping();
+}
+
 void ARunFromCameraCharacter::TouchStarted(ETouchIndex::Type FingerIndex, FVector Location)
 {
 	Jump();
@@ -140,16 +274,30 @@ void ARunFromCameraCharacter::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 
-	CheckSprint(DeltaTime);
-
 	if ( bIsLeftMouseButtonDown && CurrentCamera == ECameraType::ThirdPerson )
 	{
 		CheckBounces();
 	}
 }
 
+void ARunFromCameraCharacter::UpdateTickState()
+{
+	const bool bShowBouncePreview = bIsLeftMouseButtonDown && CurrentCamera == ECameraType::ThirdPerson;
+	if ( !bShowBouncePreview )
+	{
+		TrajectoryPreview->HidePath();
+	}
+
+	SetActorTickEnabled(bShowBouncePreview || bBlueprintTicks);
+}
+
 void ARunFromCameraCharacter::MoveForward(float Value)
 {
+	if ( SessionRecording )
+	{
+		SessionRecording->RecordAxis(ESessionRecordType::MoveForward, Value);
+	}
+
 	if ( (Controller != nullptr) && (Value != 0.0f) )
 	{
 		// find out which way is forward
@@ -164,6 +312,11 @@ void ARunFromCameraCharacter::MoveForward(float Value)
 
 void ARunFromCameraCharacter::MoveRight(float Value)
 {
+	if ( SessionRecording )
+	{
+		SessionRecording->RecordAxis(ESessionRecordType::MoveRight, Value);
+	}
+
 	if ( (Controller != nullptr) && (Value != 0.0f) )
 	{
 		// find out which way is right
@@ -180,6 +333,8 @@ void ARunFromCameraCharacter::MoveRight(float Value)
 
 void ARunFromCameraCharacter::ChangePOV()
 {
+	RecordSessionEvent(ESessionRecordType::ChangePOV);
+
 	switch ( CurrentCamera )
 	{
 		case ECameraType::ThirdPerson:
@@ -201,25 +356,35 @@ void ARunFromCameraCharacter::ChangePOV()
 			UE_LOG(LogTemp, Error, TEXT("Current camera type is not viable!"));
 
 	}
+
+	UpdateTickState();
 }
 
 void ARunFromCameraCharacter::StartSprint()
 {
+	RecordSessionEvent(ESessionRecordType::StartSprint);
+
 	if ( !bIsCrouched )
 	{
 		bIsSprinting = true;
 		GetCharacterMovement()->MaxWalkSpeed = SprintSpeed;
+		UpdateStaminaRate();
 	}
 }
 
 void ARunFromCameraCharacter::StopSprint()
 {
+	RecordSessionEvent(ESessionRecordType::StopSprint);
+
 	bIsSprinting = false;
 	GetCharacterMovement()->MaxWalkSpeed = WalkSpeed;
+	UpdateStaminaRate();
 }
 
 void ARunFromCameraCharacter::Zoom()
 {
+	RecordSessionEvent(ESessionRecordType::Zoom);
+
 	if ( CurrentCamera == ECameraType::FirstPerson )
 	{
 		if ( bIsZoomed )
@@ -235,34 +400,76 @@ void ARunFromCameraCharacter::Zoom()
 	}
 }
 
-void ARunFromCameraCharacter::CheckSprint(float deltaTime)
+float ARunFromCameraCharacter::GetCurrentStaminaLevel() const
 {
+	const UWorld* World = GetWorld();
+	if ( !World || StaminaRate == 0.f )
+	{
+		return CurrentStaminaLevel;
+	}
+
+	const float ElapsedTime = static_cast<float>(World->GetTimeSeconds() - StaminaChangeTime);
+	return FMath::Clamp(CurrentStaminaLevel + StaminaRate * ElapsedTime, 0.f, MaxStaminaLevel);
+}
+
+void ARunFromCameraCharacter::SetCurrentStaminaLevel(float NewStaminaLevel)
+{
+	CurrentStaminaLevel = FMath::Clamp(NewStaminaLevel, 0.f, MaxStaminaLevel);
+	StaminaRate = 0.f;
+
+	if ( HasActorBegunPlay() )
+	{
+		UpdateStaminaRate();
+	}
+}
+
+void ARunFromCameraCharacter::UpdateStaminaRate()
+{
+	UWorld* World = GetWorld();
+	CurrentStaminaLevel = GetCurrentStaminaLevel();
+	StaminaChangeTime = World->GetTimeSeconds();
+	GetWorldTimerManager().ClearTimer(SprintExhaustedTimer);
+
 	if ( bIsSprinting )
 	{
-		if (CurrentStaminaLevel > 0.f)
+		StaminaRate = -StaminaDrainRate;
+		if ( StaminaDrainRate <= 0.f )
+		{
+			return;
+		}
+
+		//Stop sprinting right when stamina hits 0
+		const float TimeToExhaustion = CurrentStaminaLevel / StaminaDrainRate;
+		if ( TimeToExhaustion > 0.f )
 		{
-			CurrentStaminaLevel = FMath::FInterpConstantTo(CurrentStaminaLevel, 0.f, deltaTime, StaminaDrainRate);
+			GetWorldTimerManager().SetTimer(SprintExhaustedTimer, this, &ARunFromCameraCharacter::OnStaminaExhausted, TimeToExhaustion, false);
 		}
-		//We've hit 0 stamina. Stop sprinting.
 		else
 		{
-			GetCharacterMovement()->MaxWalkSpeed = WalkSpeed;
-			bIsSprinting = false;
+			OnStaminaExhausted();
 		}
 	}
-	//Recharge stamina
+	//Recharge stamina, GetCurrentStaminaLevel stops at MaxStaminaLevel on its own
 	else
 	{
-		if (CurrentStaminaLevel < MaxStaminaLevel)
-		{
-			CurrentStaminaLevel = FMath::FInterpConstantTo(CurrentStaminaLevel, MaxStaminaLevel, deltaTime, StaminaRechargeRate);
-		}
+		StaminaRate = CurrentStaminaLevel < MaxStaminaLevel ? StaminaRechargeRate : 0.f;
 	}
 }
 
+void ARunFromCameraCharacter::OnStaminaExhausted()
+{
+	GetCharacterMovement()->MaxWalkSpeed = WalkSpeed;
+	bIsSprinting = false;
+	UpdateStaminaRate();
+}
+
 
 void ARunFromCameraCharacter::Fire()
 {
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_CharacterFire);
+
+	RecordSessionEvent(ESessionRecordType::FireUp);
+
 	if ( ProjectileClass )
 	{
 		FVector CameraLocation;
@@ -274,156 +481,443 @@ void ARunFromCameraCharacter::Fire()
 		FVector MuzzleLocation = CameraLocation + FTransform(CameraRotation).TransformVector(MuzzleOffset);
 		FRotator MuzzleRotation = CameraRotation;
 
-		UWorld* World = GetWorld();
-		if ( World )
-		{
-			FActorSpawnParameters SpawnParams;
-			SpawnParams.Owner = this;
-			SpawnParams.Instigator = GetInstigator();
+		// Set the projectile's initial trajectory.
+		FVector LaunchDirection = MuzzleRotation.Vector();
+		const FProjectilePreset& Preset = CurrentCamera == ECameraType::ThirdPerson ? ThirdPersonProjectilePreset : FirstPersonProjectilePreset;
+		FVector BulletCamTarget = FVector::ZeroVector;
+		const bool bStartBulletCam = CurrentCamera == ECameraType::FirstPerson && CheckHitForBulletCam(MuzzleLocation, LaunchDirection, BulletCamTarget);
 
-			// Spawn the projectile at the muzzle.
-			AProjectile* Projectile = World->SpawnActor<AProjectile>(ProjectileClass, MuzzleLocation, MuzzleRotation, SpawnParams);
+		UWorld* World = GetWorld();
+		UProjectileManagerSubsystem* ProjectileManager = World ? World->GetSubsystem<UProjectileManagerSubsystem>() : nullptr;
+		UProjectilePoolSubsystem* Pool = World ? World->GetSubsystem<UProjectilePoolSubsystem>() : nullptr;
 
-			if ( CurrentCamera == ECameraType::ThirdPerson )
-				Projectile->ProjectileMovementComponent->bShouldBounce = true;
+		// Only the bullet followed by the bullet cam needs to be a real actor
+		if ( !bStartBulletCam && ProjectileManager && ProjectileManager->IsSimulationEnabled() )
+		{
+			ProjectileManager->Launch(ProjectileClass, MuzzleLocation, LaunchDirection, Preset, this);
+		}
+		else if ( Pool )
+		{
+			// Take a projectile from the pool and place it at the muzzle.
+			AProjectile* Projectile = Pool->Acquire(ProjectileClass, MuzzleLocation, MuzzleRotation, Preset, this, GetInstigator());
 
 			if ( Projectile )
 			{
-				// Set the projectile's initial trajectory.
-				FVector LaunchDirection = MuzzleRotation.Vector();
-				if ( CurrentCamera == ECameraType::FirstPerson )
-					CheckHitForBulletCam(Projectile, MuzzleLocation, LaunchDirection);
+				if ( bStartBulletCam )
+					StartBulletCam(Projectile, BulletCamTarget);
 				Projectile->FireInDirection(LaunchDirection);
 			}
 		}
+
+		if ( ProjectileManager )
+		{
+			ProjectileManager->RecordShot();
+		}
+
+		RecordSessionEvent(ESessionRecordType::Shot);
+		SendFireEvent(MuzzleLocation, LaunchDirection);
 	}
 	bIsLeftMouseButtonDown = false;
+	UpdateTickState();
+}
+
+void ARunFromCameraCharacter::SendFireEvent(const FVector& MuzzleLocation, const FVector& LaunchDirection)
+{
+	const ENetMode NetMode = GetNetMode();
+	UProjectileManagerSubsystem* ProjectileManager = GetWorld()->GetSubsystem<UProjectileManagerSubsystem>();
+	if ( NetMode == NM_Standalone || !ProjectileManager )
+	{
+		return;
+	}
+
+	const FProjectileFireEvent FireEvent = ProjectileManager->MakeFireEvent(MuzzleLocation, LaunchDirection, CurrentCamera == ECameraType::ThirdPerson ? 1 : 0);
+	if ( NetMode == NM_Client )
+	{
+		ServerFire(FireEvent);
+	}
+	else
+	{
+		ProjectileManager->RecordFireEventSent(FireEvent);
+		MulticastFire(FireEvent);
+	}
+}
+
+void ARunFromCameraCharacter::ServerFire_Implementation(const FProjectileFireEvent& FireEvent)
+{
+	// A shot has to leave from somewhere near us, anything else is dropped rather than trusted
+	if ( FVector::DistSquared(FireEvent.MuzzleLocation, GetActorLocation()) > FMath::Square(MaxFireEventMuzzleDistance) )
+	{
+		return;
+	}
+
+	// The server's copy is the one that scores, it never needs the bullet cam
+	UProjectileManagerSubsystem* ProjectileManager = GetWorld()->GetSubsystem<UProjectileManagerSubsystem>();
+	if ( ProjectileManager )
+	{
+		const FProjectilePreset& Preset = FireEvent.PresetIndex == 1 ? ThirdPersonProjectilePreset : FirstPersonProjectilePreset;
+		ProjectileManager->LaunchFromFireEvent(ProjectileClass, FireEvent, Preset, this);
+		ProjectileManager->RecordShot();
+		ProjectileManager->RecordFireEventSent(FireEvent);
+	}
+
+	RecordSessionEvent(ESessionRecordType::Shot);
+	MulticastFire(FireEvent);
+}
+
+void ARunFromCameraCharacter::MulticastFire_Implementation(const FProjectileFireEvent& FireEvent)
+{
+	// The server already flies its copy and the shooter fired before telling anyone
+	if ( HasAuthority() || IsLocallyControlled() )
+	{
+		return;
+	}
+
+	if ( UProjectileManagerSubsystem* ProjectileManager = GetWorld()->GetSubsystem<UProjectileManagerSubsystem>() )
+	{
+		const FProjectilePreset& Preset = FireEvent.PresetIndex == 1 ? ThirdPersonProjectilePreset : FirstPersonProjectilePreset;
+		ProjectileManager->LaunchFromFireEvent(ProjectileClass, FireEvent, Preset, this);
+	}
+}
+
+void ARunFromCameraCharacter::GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const
+{
+	Super::GetLifetimeReplicatedProps(OutLifetimeProps);
+
+	DOREPLIFETIME_CONDITION(ARunFromCameraCharacter, Points, COND_OwnerOnly);
 }
 
 void ARunFromCameraCharacter::LeftMouseButtonDown()
 {
+	RecordSessionEvent(ESessionRecordType::FireDown);
 	bIsLeftMouseButtonDown = true;
+	UpdateTickState();
 }
 
 
-void ARunFromCameraCharacter::CheckHitForBulletCam(AProjectile* Projectile, FVector MuzzleLocation, FVector LaunchDirection)
+bool ARunFromCameraCharacter::CheckHitForBulletCam(FVector MuzzleLocation, FVector LaunchDirection, FVector& OutHitLocation)
 {
-	FPredictProjectilePathParams params;
-	params.StartLocation = MuzzleLocation;
-	params.LaunchVelocity = LaunchDirection * 3000.f;
-	params.bTraceWithChannel = true;
-	params.ProjectileRadius = 5.f;
-	params.TraceChannel = ECC_Pawn;
-	params.bTraceWithCollision = true;
-	params.ActorsToIgnore.Add(this);
-	params.OverrideGravityZ = 1.f;
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_CheckHitForBulletCam);
+
+	// First person shots don't ricochet, the first thing in the way decides
+	FRicochetSolverParams SolverParams;
+	SolverParams.StartLocation = MuzzleLocation;
+	SolverParams.Direction = LaunchDirection;
+	SolverParams.ProjectileRadius = BouncePreviewRadius;
+	SolverParams.TraceChannel = ECC_ProjectileTrace;
+	SolverParams.MaxBounces = 0;
+	SolverParams.MaxDistance = FirstPersonProjectilePreset.InitialSpeed * FirstPersonProjectilePreset.LifeSpan;
+	SolverParams.IgnoredActor = this;
+
+	FRicochetPath Path;
+	if ( !FRicochetSolver::Solve(GetWorld(), SolverParams, Path) )
+	{
+		return false;
+	}
 
-	FPredictProjectilePathResult result;
+	AActor* HitActor = Path.LastHit.GetActor();
+	OutHitLocation = Path.LastHit.Location;
+	return HitActor && HitActor->IsA(APacificator::StaticClass());
+}
+
+void ARunFromCameraCharacter::StartBulletCam(AProjectile* Projectile, const FVector& TargetLocation)
+{
+	APlayerController* OurPlayerController = UGameplayStatics::GetPlayerController(this, 0);
+	UProjectilePoolSubsystem* Pool = GetWorld()->GetSubsystem<UProjectilePoolSubsystem>();
+	ABulletCamRig* BulletCamRig = Pool ? Pool->GetBulletCamRig() : nullptr;
+	if (OurPlayerController && BulletCamRig)
+	{
+		// The rig has to be in place before CameraWarp starts animating its arm
+		BulletCamRig->AttachToProjectile(Projectile);
+		Projectile->SetIsBulletCamActive(true);
+		Projectile->CameraWarp();
+
+		//Set bigger speeds for bullet to be faster than turret ones to avoid getting killed while bullet cam is active
+		Projectile->ProjectileMovementComponent->InitialSpeed = 4500.f;
+		Projectile->ProjectileMovementComponent->MaxSpeed = 6000.f;
+		CurrentCamera = ECameraType::BulletCam;
+		this->DisableInput(OurPlayerController);
+
+		UGameplayStatics::SetGlobalTimeDilation(GetWorld(), TimeDilationManipulator);
+		OurPlayerController->SetViewTargetWithBlend(Projectile, TimeDilationManipulator);
+
+		// Only the bullet's path is on screen now, everything else can tick slowly until we're back
+		if ( UBulletCamFocusSubsystem* Focus = GetWorld()->GetSubsystem<UBulletCamFocusSubsystem>() )
+			Focus->BeginFocus(Projectile, Projectile->GetActorLocation(), TargetLocation, BulletCamRig->BulletCam->FieldOfView);
+
+		RecordSessionEvent(ESessionRecordType::BulletCamStart);
+		BeginBulletCamCapture();
+	}
+	bUseControllerRotationYaw = false;
+}
 
-	UGameplayStatics::PredictProjectilePath(GetWorld(), params, result);
+void ARunFromCameraCharacter::BeginBulletCamCapture()
+{
+	CSV_EVENT(RunFromCamera, TEXT("BulletCamStart"));
 
-	if (result.HitResult.bBlockingHit)
+#if CSV_PROFILER
+	// Leave captures someone else started alone
+	FCsvProfiler* CsvProfiler = FCsvProfiler::Get();
+	if ( CVarCaptureBulletCam.GetValueOnGameThread() && !CsvProfiler->IsCapturing() )
 	{
-		APlayerController* OurPlayerController = UGameplayStatics::GetPlayerController(this, 0);
-		if (result.HitResult.GetActor()->IsA(APacificator::StaticClass()))
-		{
-			auto camera = Projectile->BulletCam;
-			if (OurPlayerController)
-			{
-				Projectile->SetIsBulletCamActive(true);
-				Projectile->CameraWarp();
+		CsvProfiler->BeginCapture(-1, FString(), FString::Printf(TEXT("BulletCam-%s.csv"), *FDateTime::Now().ToString()));
+		bCapturingBulletCam = true;
+	}
+#endif
+}
 
-				//Set bigger speeds for bullet to be faster than turret ones to avoid getting killed while bullet cam is active
-				Projectile->ProjectileMovementComponent->InitialSpeed = 4500.f;
-				Projectile->ProjectileMovementComponent->MaxSpeed = 6000.f;
-				CurrentCamera = ECameraType::BulletCam;
-				this->DisableInput(OurPlayerController);
+void ARunFromCameraCharacter::EndBulletCamCapture()
+{
+	CSV_EVENT(RunFromCamera, TEXT("BulletCamEnd"));
 
-				UGameplayStatics::SetGlobalTimeDilation(GetWorld(), TimeDilationManipulator);
-				OurPlayerController->SetViewTargetWithBlend(Projectile, TimeDilationManipulator);
-			}
-			bUseControllerRotationYaw = false;
-		}
+#if CSV_PROFILER
+	if ( bCapturingBulletCam )
+	{
+		FCsvProfiler::Get()->EndCapture();
+		bCapturingBulletCam = false;
 	}
+#endif
 }
 
 
 void ARunFromCameraCharacter::CheckBounces()
 {
-	TArray<FVector> Bounces;
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_CheckBounces);
+
+	// The preview wasn't shown last frame, whatever it holds belongs to an old aim
+	if ( LastBouncePreviewFrame + 1 < GFrameCounter )
+	{
+		BouncePathCache = FBouncePathCache();
+		BounceTraceHandle.Invalidate();
+	}
+	LastBouncePreviewFrame = GFrameCounter;
 
-	// Initial data setup
 	FVector CameraLocation;
 	FRotator CameraRotation;
 	GetActorEyesViewPoint(CameraLocation, CameraRotation);
-	MuzzleOffset.Set(0.f, 0.0f, 0.0f);
 
-	FVector MuzzleLocation = CameraLocation + FTransform(CameraRotation).TransformVector(MuzzleOffset);
-	FRotator MuzzleRotation = CameraRotation;
-	FVector LaunchDirection = MuzzleRotation.Vector();
+	FRicochetSolverParams SolverParams;
+	// Starts at the eyes, not at Fire's muzzle offset, so the path never begins on the far side of a nearby wall
+	SolverParams.StartLocation = CameraLocation;
+	SolverParams.Direction = CameraRotation.Vector();
+	SolverParams.ProjectileRadius = BouncePreviewRadius;
+	SolverParams.TraceChannel = ECC_ProjectileTrace;
+	SolverParams.MaxBounces = FMath::Max(CVarBouncePreviewMaxBounces.GetValueOnGameThread(), 0);
+	SolverParams.MaxDistance = ThirdPersonProjectilePreset.InitialSpeed * ThirdPersonProjectilePreset.LifeSpan;
+	SolverParams.IgnoredActor = this;
+
+	if ( CVarBouncePathCache.GetValueOnGameThread() && IsBouncePathCacheValid(SolverParams) )
+	{
+		INC_DWORD_STAT(STAT_BouncePathCacheHits);
+
+		// Anything still in flight was started for an older aim
+		BounceTraceHandle.Invalidate();
+	}
+	else
+	{
+		INC_DWORD_STAT(STAT_BouncePathCacheMisses);
+
+		if ( CVarAsyncBouncePreview.GetValueOnGameThread() )
+		{
+			CheckBouncesAsync(SolverParams);
+		}
+		else
+		{
+			CheckBouncesSync(SolverParams);
+		}
+	}
 
-	FPredictProjectilePathParams params;
-	params.StartLocation = MuzzleLocation;
-	params.LaunchVelocity = LaunchDirection * 3000.f;
-	params.bTraceWithChannel = true;
-	params.ProjectileRadius = 5.f;
-	params.TraceChannel = ECC_Pawn;
-	params.bTraceWithCollision = true;
-	params.ActorsToIgnore.Add(this);
-	params.OverrideGravityZ = 1.f;
+	DrawBouncePreview();
+}
 
-	FPredictProjectilePathResult result;
-	UGameplayStatics::PredictProjectilePath(GetWorld(), params, result);
+void ARunFromCameraCharacter::CheckBouncesSync(const FRicochetSolverParams& SolverParams)
+{
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_BouncePreviewSync);
 
-	//Step 1 of bouncing
-	if (result.HitResult.bBlockingHit)
-	{
-		// Move the impact point along the normal of Impact point - so that the middle of the point is not on the wall but 
-		// moved further from the wall to be more in-line with the collision of an object
-		auto Direction = result.HitResult.ImpactNormal;
-		Direction *= (params.ProjectileRadius * 2);
-		params.StartLocation = result.HitResult.ImpactPoint + Direction;
+	FRicochetPath Path;
+	FRicochetSolver::Solve(GetWorld(), SolverParams, Path);
+	StoreBouncePath(SolverParams, Path);
+}
 
-		Bounces.Add(MuzzleLocation);
-		Bounces.Add(params.StartLocation);
+void ARunFromCameraCharacter::CheckBouncesAsync(const FRicochetSolverParams& SolverParams)
+{
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_BouncePreviewAsync);
 
-		params.ActorsToIgnore.Add(result.HitResult.GetActor());
+	UWorld* World = GetWorld();
 
-		params.LaunchVelocity = UKismetMathLibrary::MirrorVectorByNormal(params.LaunchVelocity, Direction); 
-		params.LaunchVelocity *= 3000.f;
+	if ( BounceTraceHandle.IsValid() )
+	{
+		FTraceDatum Datum;
+		if ( World->QueryTraceData(BounceTraceHandle, Datum) )
+		{
+			BounceTraceHandle.Invalidate();
 
-		UGameplayStatics::PredictProjectilePath(GetWorld(), params, result);
-		if (result.HitResult.bBlockingHit)
+			const FHitResult* Hit = Datum.OutHits.Num() > 0 && Datum.OutHits[0].bBlockingHit ? &Datum.OutHits[0] : nullptr;
+			if ( !Hit )
+			{
+				// The shot leaves the level before ricocheting enough, there is nothing to draw but the result is still worth caching
+				PendingBouncePath.Points.Add(Datum.End);
+				PendingBouncePath.HitActors.Add(nullptr);
+				StoreBouncePath(PendingSolverParams, PendingBouncePath);
+			}
+			else
+			{
+				PendingBouncePath.HitActors.Add(Hit->GetActor());
+				PendingRemainingDistance -= Hit->Distance;
+
+				if ( PendingBouncePath.GetNumSegments() > PendingSolverParams.MaxBounces || PendingRemainingDistance <= 0.f )
+				{
+					PendingBouncePath.Points.Add(Hit->ImpactPoint);
+					PendingBouncePath.LastHit = *Hit;
+					StoreBouncePath(PendingSolverParams, PendingBouncePath);
+				}
+				else
+				{
+					FVector Start;
+					FRicochetSolver::Reflect(*Hit, BounceTraceDirection, PendingSolverParams.ProjectileRadius, Start, BounceTraceDirection);
+
+					PendingBouncePath.Points.Add(Start);
+					IssueBounceTrace(Start, Hit->GetActor());
+				}
+			}
+		}
+		else if ( !World->IsTraceHandleValid(BounceTraceHandle, false) )
 		{
-			Direction = result.HitResult.ImpactNormal;
-			Direction *= (params.ProjectileRadius * 2);
-			params.StartLocation = result.HitResult.ImpactPoint + Direction;
+			// The result was dropped (e.g. a hitch skipped the frame it was valid for), start over
+			BounceTraceHandle.Invalidate();
+		}
+	}
 
-			Bounces.Add(params.StartLocation);
+	if ( !BounceTraceHandle.IsValid() )
+	{
+		PendingSolverParams = SolverParams;
+		PendingRemainingDistance = SolverParams.MaxDistance;
+		PendingBouncePath.Reset();
+		PendingBouncePath.Points.Add(SolverParams.StartLocation);
+		BounceTraceDirection = SolverParams.Direction;
+
+		INC_DWORD_STAT(STAT_TrajectoryPredictions);
+		CSV_CUSTOM_STAT(RunFromCamera, TrajectoryPredictions, 1, ECsvCustomStatOp::Accumulate);
+		IssueBounceTrace(SolverParams.StartLocation, nullptr);
+	}
+}
 
+void ARunFromCameraCharacter::IssueBounceTrace(const FVector& Start, AActor* IgnoredActor)
+{
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(BouncePreview), false, this);
+	QueryParams.AddIgnoredActor(IgnoredActor);
 
-			params.ActorsToIgnore.Empty();
-			params.ActorsToIgnore.Add(result.HitResult.GetActor());
+	BounceTraceHandle = GetWorld()->AsyncSweepByChannel(EAsyncTraceType::Single, Start, Start + BounceTraceDirection * PendingRemainingDistance, FQuat::Identity,
+		PendingSolverParams.TraceChannel, FCollisionShape::MakeSphere(PendingSolverParams.ProjectileRadius), QueryParams);
 
-			params.LaunchVelocity = UKismetMathLibrary::MirrorVectorByNormal(params.LaunchVelocity, Direction);
-			UGameplayStatics::PredictProjectilePath(GetWorld(), params, result);
+	INC_DWORD_STAT(STAT_BouncePreviewAsyncSweeps);
+}
 
-			//Two bounces found. Draw the path with debug lines/spheres.
-			if (result.HitResult.bBlockingHit)
-			{
-				DrawDebugLine(GetWorld(), Bounces[0], Bounces[1], FColor::Green);
-				DrawDebugSphere(GetWorld(), Bounces[1], 10.f, 16, FColor::Red);
-				DrawDebugLine(GetWorld(), Bounces[1], Bounces[2], FColor::Blue);
-				DrawDebugSphere(GetWorld(), Bounces[2], 10.f, 16, FColor::Red);
-				DrawDebugLine(GetWorld(), params.StartLocation, result.HitResult.ImpactPoint, FColor::Red);
-				DrawDebugSphere(GetWorld(), result.HitResult.ImpactPoint, 15.f, 16, FColor::Red);
+void ARunFromCameraCharacter::StoreBouncePath(const FRicochetSolverParams& SolverParams, const FRicochetPath& Path)
+{
+	BouncePathCache.MuzzleLocation = SolverParams.StartLocation;
+	BouncePathCache.LaunchDirection = SolverParams.Direction;
+	BouncePathCache.Path = Path;
+	BouncePathCache.NextSegmentToValidate = 0;
+	BouncePathCache.bComplete = Path.EndsInBlockingHit() && Path.GetNumSegments() == SolverParams.MaxBounces + 1;
+	BouncePathCache.bValid = Path.GetNumSegments() > 0;
+
+	BouncePathCache.HitActorTransforms.Reset();
+	for ( const TWeakObjectPtr<AActor>& HitActor : Path.HitActors )
+	{
+		const AActor* Actor = HitActor.Get();
+		BouncePathCache.HitActorTransforms.Add(Actor ? Actor->GetActorTransform() : FTransform::Identity);
+	}
+}
 
-			}
+bool ARunFromCameraCharacter::IsBouncePathCacheValid(const FRicochetSolverParams& SolverParams)
+{
+	const FBouncePathCache& Cache = BouncePathCache;
+	const FRicochetPath& Path = Cache.Path;
+	if ( !Cache.bValid )
+	{
+		return false;
+	}
+
+	const float PositionTolerance = CVarBouncePathCachePositionTolerance.GetValueOnGameThread();
+	if ( FVector::DistSquared(SolverParams.StartLocation, Cache.MuzzleLocation) > FMath::Square(PositionTolerance) )
+	{
+		return false;
+	}
+
+	const float AngleTolerance = CVarBouncePathCacheAngleTolerance.GetValueOnGameThread();
+	if ( (SolverParams.Direction | Cache.LaunchDirection) < FMath::Cos(FMath::DegreesToRadians(AngleTolerance)) )
+	{
+		return false;
+	}
+
+	// Anything the path ricochets off must be exactly where it was
+	for ( int32 Index = 0; Index < Path.HitActors.Num(); ++Index )
+	{
+		if ( Path.HitActors[Index].IsExplicitlyNull() )
+		{
+			continue;
+		}
+
+		const AActor* HitActor = Path.HitActors[Index].Get();
+		if ( !HitActor || !HitActor->GetActorTransform().Equals(Cache.HitActorTransforms[Index]) )
+		{
+			return false;
 		}
 	}
+
+	// Something else may have moved into the path, re-sweep one segment a frame. A segment is still clear when
+	// nothing blocks it before the actor it ended on.
+	const int32 Segment = BouncePathCache.NextSegmentToValidate;
+	BouncePathCache.NextSegmentToValidate = (Segment + 1) % Path.GetNumSegments();
+
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(BouncePreviewValidate), false, this);
+	if ( Segment > 0 )
+	{
+		QueryParams.AddIgnoredActor(Path.HitActors[Segment - 1].Get());
+	}
+
+	FHitResult Hit;
+	if ( GetWorld()->SweepSingleByChannel(Hit, Path.Points[Segment], Path.Points[Segment + 1], FQuat::Identity, SolverParams.TraceChannel, FCollisionShape::MakeSphere(SolverParams.ProjectileRadius), QueryParams)
+		&& Hit.GetActor() != Path.HitActors[Segment].Get() )
+	{
+		return false;
+	}
+
+	return true;
+}
+
+void ARunFromCameraCharacter::DrawBouncePreview()
+{
+	// Only a path that ricochets all the way is shown
+	if ( !BouncePathCache.bComplete )
+	{
+		TrajectoryPreview->HidePath();
+		return;
+	}
+
+	TrajectoryPreview->ShowPath(BouncePathCache.Path.Points);
+}
+
+void ARunFromCameraCharacter::AddPoints(size_t points)
+{
+	Points += points;
+	RecordSessionEvent(ESessionRecordType::Points, (int32)points);
 }
 
 void ARunFromCameraCharacter::Die()
+{
+	RecordSessionEvent(ESessionRecordType::Die);
+
+	if ( GetNetMode() != NM_Standalone && !IsLocallyControlled() )
+	{
+		ClientDie();
+		return;
+	}
+
+	UKismetSystemLibrary::QuitGame(this, nullptr, EQuitPreference::Quit, false);
+}
+
+void ARunFromCameraCharacter::ClientDie_Implementation()
 {
 	UKismetSystemLibrary::QuitGame(this, nullptr, EQuitPreference::Quit, false);
 }
@@ -432,12 +926,22 @@ void ARunFromCameraCharacter::ResetCameraAfterBulletCam()
 {
 	APlayerController* OurPlayerController = UGameplayStatics::GetPlayerController(this, 0);
 	this->EnableInput(OurPlayerController);
+	if ( UBulletCamFocusSubsystem* Focus = GetWorld()->GetSubsystem<UBulletCamFocusSubsystem>() )
+		Focus->EndFocus();
 	UGameplayStatics::SetGlobalTimeDilation(GetWorld(), 1.0f);
 	OurPlayerController->SetViewTarget(this);
+
+	UProjectilePoolSubsystem* Pool = GetWorld()->GetSubsystem<UProjectilePoolSubsystem>();
+	if ( ABulletCamRig* BulletCamRig = Pool ? Pool->GetBulletCamRig() : nullptr )
+		BulletCamRig->DetachFromProjectile();
+
 	CurrentCamera = ECameraType::FirstPerson;
 	ThirdPersonCamera->SetActive(false);
 	FirstPersonCamera->SetActive(true);
 	bUseControllerRotationYaw = true;
+
+	RecordSessionEvent(ESessionRecordType::BulletCamEnd);
+	EndBulletCamCapture();
 }
 
 
@@ -5,6 +5,11 @@
 #include "CoreMinimal.h"
 #include "GameFramework/Character.h"
 #include "Kismet/GameplayStaticsTypes.h"
+#include "WorldCollision.h"
+#include "ProjectilePoolSubsystem.h"
+#include "RicochetSolver.h"
+#include "SessionRecordingSubsystem.h"
+#include "ProjectileManagerSubsystem.h"
 #include "RunFromCameraCharacter.generated.h"
 
 
@@ -16,12 +21,37 @@ enum class ECameraType : uint8
 	BulletCam = 2		UMETA(DisplayName = "BulletCam")
 };
 
+/**
+ * Ricochet preview path together with the aim it was computed for.
+ */
+struct FBouncePathCache
+{
+	FVector MuzzleLocation = FVector::ZeroVector;
+
+	FVector LaunchDirection = FVector::ZeroVector;
+
+	FRicochetPath Path;
+
+	// Transform of every hit actor when the path was computed
+	TArray<FTransform, TInlineAllocator<8>> HitActorTransforms;
+
+	int32 NextSegmentToValidate = 0;
+
+	// The path ricochets the full number of times and is drawn
+	bool bComplete = false;
+
+	bool bValid = false;
+};
 
 UCLASS(config=Game)
 class ARunFromCameraCharacter : public ACharacter
 {
 	GENERATED_BODY()
 
+	// Scripts the player through the same entry points as the input bindings
+	friend class URunFromCameraBenchmarkCommandlet;
+	friend class URunFromCameraReplayCommandlet;
+
 	/** Camera boom positioning the camera behind the character */
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
 	class USpringArmComponent* CameraBoom;
@@ -33,6 +63,10 @@ class ARunFromCameraCharacter : public ACharacter
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = Camera, meta = (AllowPrivateAccess = "true"))
 	class UCameraComponent* FirstPersonCamera;
 
+	/** Ricochet path of a third person shot */
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Character | Shooting", meta = (AllowPrivateAccess = "true"))
+	class UTrajectoryPreviewComponent* TrajectoryPreview;
+
 public:
 	ARunFromCameraCharacter();
 
@@ -52,13 +86,29 @@ public:
 	UFUNCTION(BlueprintCallable)
 	int GetPoints() const { return Points; }
 
-	void AddPoints(size_t points) { Points += points; };
+	// Stamina is only stored when sprint starts or stops, in between it is worked out from the elapsed time
+	UFUNCTION(BlueprintGetter)
+	float GetCurrentStaminaLevel() const;
 
+	UFUNCTION(BlueprintSetter)
+	void SetCurrentStaminaLevel(float NewStaminaLevel);
+
+	void AddPoints(size_t points);
+
+	// Called on the server when a bullet hits us, the player quits on their own machine
 	void Die();
 
+	virtual void Jump() override;
+
+	virtual void StopJumping() override;
+
 	void ResetCameraAfterBulletCam();
 
 protected:
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	virtual void Tick(float DeltaTime) override;
 
 	/** Called for forwards/backward input */
@@ -93,21 +143,57 @@ protected:
 
 	void Zoom();
 
-	void CheckSprint(float deltaTime);
+	// Runs when SprintExhaustedTimer fires, the moment stamina hits 0 while sprinting
+	void OnStaminaExhausted();
+
+	// Settles the stamina used or regained so far and starts draining or recharging from now on
+	void UpdateStaminaRate();
+
+	// The character only ticks for the bounce preview, while fire is held in third person
+	void UpdateTickState();
 
 	UFUNCTION()
 	void Fire();
 
 	void LeftMouseButtonDown();
 
-	void CheckHitForBulletCam(class AProjectile* Projectile, FVector MuzzleLocation, FVector LaunchDirection);
+	// True when a shot fired from MuzzleLocation would hit a turret, OutHitLocation is where
+	bool CheckHitForBulletCam(FVector MuzzleLocation, FVector LaunchDirection, FVector& OutHitLocation);
+
+	void StartBulletCam(class AProjectile* Projectile, const FVector& TargetLocation);
+
+	// CSV capture bracketing the bullet cam slow motion, see RunFromCamera.Profiling.CaptureBulletCam
+	void BeginBulletCamCapture();
 
+	void EndBulletCamCapture();
+
+	// Draws the ricochet path of a third person shot, using either of the two paths below
 	void CheckBounces();
 
+	// Runs the ricochet solver on the game thread
+	void CheckBouncesSync(const FRicochetSolverParams& SolverParams);
+
+	// One async sweep per bounce, issued this frame and read back the next. The last complete path stays on screen meanwhile.
+	void CheckBouncesAsync(const FRicochetSolverParams& SolverParams);
+
+	// Tells the other machines about a shot already flying here, see FProjectileFireEvent
+	void SendFireEvent(const FVector& MuzzleLocation, const FVector& LaunchDirection);
+
+	UFUNCTION(Server, Reliable)
+	void ServerFire(const FProjectileFireEvent& FireEvent);
+
+	UFUNCTION(NetMulticast, Unreliable)
+	void MulticastFire(const FProjectileFireEvent& FireEvent);
+
+	UFUNCTION(Client, Reliable)
+	void ClientDie();
+
 	// APawn interface
 	virtual void SetupPlayerInputComponent(class UInputComponent* PlayerInputComponent) override;
 	// End of APawn interface
 
+	virtual void GetLifetimeReplicatedProps(TArray<FLifetimeProperty>& OutLifetimeProps) const override;
+
 protected:
 	UPROPERTY(VisibleAnywhere, BlueprintReadOnly, Category = "Character | Camera")
 	ECameraType CurrentCamera;
@@ -124,7 +210,8 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character | Movement")
 	bool bIsSprinting;
 
-	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character | Movement")
+	// Stamina at StaminaChangeTime, read the current value through GetCurrentStaminaLevel
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, BlueprintGetter = GetCurrentStaminaLevel, BlueprintSetter = SetCurrentStaminaLevel, Category = "Character | Movement")
 	float CurrentStaminaLevel;
 
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Character | Movement")
@@ -151,11 +238,64 @@ protected:
 	UPROPERTY(EditDefaultsOnly, Category = "Character | Shooting")
 	TSubclassOf<class AProjectile> ProjectileClass;
 
+	UPROPERTY(EditDefaultsOnly, Category = "Character | Shooting")
+	FProjectilePreset FirstPersonProjectilePreset;
+
+	// Third person shots ricochet off the walls
+	UPROPERTY(EditDefaultsOnly, Category = "Character | Shooting")
+	FProjectilePreset ThirdPersonProjectilePreset;
+
 	bool bIsLeftMouseButtonDown = false;
 
 private:
-	UPROPERTY(VisibleAnywhere, Category = "Character | Points")
+	void IssueBounceTrace(const FVector& Start, AActor* IgnoredActor);
+
+	void StoreBouncePath(const FRicochetSolverParams& SolverParams, const FRicochetPath& Path);
+
+	// Cheap check run before any prediction: aim within tolerance, hit actors unmoved and one segment re-swept
+	bool IsBouncePathCacheValid(const FRicochetSolverParams& SolverParams);
+
+	void DrawBouncePreview();
+
+	// Forwards to the session recording, a no-op unless a recording is running
+	void RecordSessionEvent(ESessionRecordType Type, int32 Value = 0);
+
+	UPROPERTY()
+	USessionRecordingSubsystem* SessionRecording = nullptr;
+
+	// Scored on the server, replicated to the player for the HUD
+	UPROPERTY(VisibleAnywhere, Replicated, Category = "Character | Points")
 	int Points;
 
+	// Last ricochet path, drawn every frame and reused while it stays valid
+	FBouncePathCache BouncePathCache;
+
+	// Sweep of the async ricochet preview currently in flight
+	FTraceHandle BounceTraceHandle;
+
+	FVector BounceTraceDirection = FVector::ZeroVector;
+
+	// Path the in-flight sweeps are building and the aim it was started from
+	FRicochetPath PendingBouncePath;
+
+	FRicochetSolverParams PendingSolverParams;
+
+	float PendingRemainingDistance = 0.f;
+
+	uint64 LastBouncePreviewFrame = 0;
+
+	// World time CurrentStaminaLevel was last settled at
+	double StaminaChangeTime = 0.0;
+
+	// Stamina per second from StaminaChangeTime on, negative while sprinting
+	float StaminaRate = 0.f;
+
+	FTimerHandle SprintExhaustedTimer;
+
+	// A Blueprint Event Tick keeps the character ticking no matter what the bounce preview needs
+	bool bBlueprintTicks = false;
+
+	bool bCapturingBulletCam = false;
+
 };
 
@@ -1,15 +1,118 @@
 // Copyright Epic Games, Inc. All Rights Reserved.
 
 #include "RunFromCameraGameMode.h"
+#include "RunFromCamera.h"
 #include "RunFromCameraCharacter.h"
-#include "UObject/ConstructorHelpers.h"
+#include "Pacificator.h"
+#include "Engine/AssetManager.h"
 
 ARunFromCameraGameMode::ARunFromCameraGameMode()
 {
 	// set default pawn class to our Blueprinted character
-	static ConstructorHelpers::FClassFinder<APawn> PlayerPawnBPClass(TEXT("/Game/ThirdPerson/Blueprints/BP_ThirdPersonCharacter"));
-	if (PlayerPawnBPClass.Class != NULL)
+	PlayerPawnClass = TSoftClassPtr<APawn>(FSoftObjectPath(TEXT("/Game/ThirdPerson/Blueprints/BP_ThirdPersonCharacter.BP_ThirdPersonCharacter_C")));
+	PreloadPacificatorClasses.Add(TSoftClassPtr<APacificator>(FSoftObjectPath(TEXT("/Game/PacificatorCamera/Pacificator_BP.Pacificator_BP_C"))));
+}
+
+void ARunFromCameraGameMode::InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage)
+{
+	Super::InitGame(MapName, Options, ErrorMessage);
+
+	TArray<FSoftObjectPath> PreloadBundle;
+	GetPreloadBundle(PreloadBundle);
+	if (PreloadBundle.Num() == 0)
+		return;
+
+	PreloadStartTime = FPlatformTime::Seconds();
+	RequestPreload(MoveTemp(PreloadBundle));
+}
+
+void ARunFromCameraGameMode::RequestPreload(TArray<FSoftObjectPath>&& Assets)
+{
+	RequestedPreloadAssets = MoveTemp(Assets);
+	PreloadHandle = UAssetManager::GetStreamableManager().RequestAsyncLoad(RequestedPreloadAssets, FStreamableDelegate::CreateUObject(this, &ARunFromCameraGameMode::OnPreloadBundleLoaded), FStreamableManager::AsyncLoadHighPriority);
+}
+
+void ARunFromCameraGameMode::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (PreloadHandle.IsValid())
+	{
+		PreloadHandle->CancelHandle();
+		PreloadHandle.Reset();
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void ARunFromCameraGameMode::GetPreloadBundle(TArray<FSoftObjectPath>& OutAssets) const
+{
+	if (!PlayerPawnClass.IsNull())
+		OutAssets.Add(PlayerPawnClass.ToSoftObjectPath());
+
+	for (const TSoftClassPtr<APacificator>& PacificatorClass : PreloadPacificatorClasses)
+	{
+		if (PacificatorClass.IsNull())
+			continue;
+
+		OutAssets.AddUnique(PacificatorClass.ToSoftObjectPath());
+		APacificator::GetPreloadAssets(PacificatorClass.Get(), OutAssets);
+	}
+
+	for (const FSoftObjectPath& Asset : AdditionalPreloadAssets)
+	{
+		if (Asset.IsValid())
+			OutAssets.AddUnique(Asset);
+	}
+}
+
+void ARunFromCameraGameMode::OnPreloadBundleLoaded()
+{
+	int32 NumFailed = 0;
+	for (const FSoftObjectPath& Asset : RequestedPreloadAssets)
 	{
-		DefaultPawnClass = PlayerPawnBPClass.Class;
+		if (!Asset.ResolveObject())
+		{
+			UE_LOG(LogRunFromCamera, Error, TEXT("Preload bundle could not load %s"), *Asset.ToString());
+			++NumFailed;
+		}
 	}
+
+	UE_LOG(LogRunFromCamera, Log, TEXT("Preload bundle: %d of %d assets streamed in %.1f ms"), RequestedPreloadAssets.Num() - NumFailed, RequestedPreloadAssets.Num(),
+		(FPlatformTime::Seconds() - PreloadStartTime) * 1000.0);
+
+	if (bRequestedPacificatorMaterials)
+		return;
+
+	// The turret classes are in now, what their defaults point at wasn't part of the first request
+	bRequestedPacificatorMaterials = true;
+
+	TArray<FSoftObjectPath> FollowUpAssets;
+	GetPreloadBundle(FollowUpAssets);
+	FollowUpAssets.RemoveAll([this](const FSoftObjectPath& Asset) { return RequestedPreloadAssets.Contains(Asset) || Asset.ResolveObject() != nullptr; });
+	if (FollowUpAssets.Num() == 0)
+		return;
+
+	UE_LOG(LogRunFromCamera, Log, TEXT("Preload bundle: queued %d assets referenced by the turret classes"), FollowUpAssets.Num());
+	RequestPreload(MoveTemp(FollowUpAssets));
+}
+
+UClass* ARunFromCameraGameMode::GetDefaultPawnClassForController_Implementation(AController* InController)
+{
+	if (PlayerPawnClass.IsNull())
+		return Super::GetDefaultPawnClassForController_Implementation(InController);
+
+	UClass* PawnClass = PlayerPawnClass.Get();
+	if (!PawnClass)
+	{
+		// The player can arrive before the bundle is in, waiting for it here still beats a hard reference
+		UE_LOG(LogRunFromCamera, Log, TEXT("%s not preloaded yet, loading it now"), *PlayerPawnClass.ToString());
+		PawnClass = PlayerPawnClass.LoadSynchronous();
+	}
+
+	if (!PawnClass)
+	{
+		UE_LOG(LogRunFromCamera, Error, TEXT("Could not load player pawn %s, falling back to %s"), *PlayerPawnClass.ToString(), *GetNameSafe(DefaultPawnClass));
+		return Super::GetDefaultPawnClassForController_Implementation(InController);
+	}
+
+	return PawnClass;
 }
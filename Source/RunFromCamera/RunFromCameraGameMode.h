@@ -4,8 +4,11 @@
 
 #include "CoreMinimal.h"
 #include "GameFramework/GameModeBase.h"
+#include "Engine/StreamableManager.h"
 #include "RunFromCameraGameMode.generated.h"
 
+class APacificator;
+
 UCLASS(minimalapi)
 class ARunFromCameraGameMode : public AGameModeBase
 {
@@ -13,7 +16,41 @@ class ARunFromCameraGameMode : public AGameModeBase
 
 public:
 	ARunFromCameraGameMode();
-};
 
+	// Starts streaming the preload bundle while the rest of the map loads
+	virtual void InitGame(const FString& MapName, const FString& Options, FString& ErrorMessage) override;
+
+	virtual UClass* GetDefaultPawnClassForController_Implementation(AController* InController) override;
+
+	// Player pawn, turret classes and the materials of those already loaded, plus anything listed in AdditionalPreloadAssets
+	void GetPreloadBundle(TArray<FSoftObjectPath>& OutAssets) const;
+
+protected:
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+	// Soft so the game mode class doesn't drag the whole character Blueprint in with it
+	UPROPERTY(EditDefaultsOnly, Category = "Classes")
+	TSoftClassPtr<APawn> PlayerPawnClass;
+
+	// Turret Blueprints placed in the maps. Their light materials are only known from their defaults, so they are
+	// requested in a second step once the classes are in.
+	UPROPERTY(EditDefaultsOnly, Category = "Preload")
+	TArray<TSoftClassPtr<APacificator>> PreloadPacificatorClasses;
 
+	UPROPERTY(EditDefaultsOnly, Category = "Preload")
+	TArray<FSoftObjectPath> AdditionalPreloadAssets;
 
+private:
+	void RequestPreload(TArray<FSoftObjectPath>&& Assets);
+
+	void OnPreloadBundleLoaded();
+
+	TSharedPtr<FStreamableHandle> PreloadHandle;
+
+	// What PreloadHandle was asked for, only these are checked when it completes
+	TArray<FSoftObjectPath> RequestedPreloadAssets;
+
+	double PreloadStartTime = 0.0;
+
+	bool bRequestedPacificatorMaterials = false;
+};
@@ -0,0 +1,254 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "RunFromCameraReplayCommandlet.h"
+#include "RunFromCamera.h"
+#include "RunFromCameraCharacter.h"
+#include "Engine/Engine.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "UObject/Package.h"
+
+URunFromCameraReplayCommandlet::URunFromCameraReplayCommandlet()
+{
+	IsClient = false;
+	IsEditor = false;
+	IsServer = true;
+	LogToConsole = true;
+}
+
+int32 URunFromCameraReplayCommandlet::Main(const FString& Params)
+{
+	FString Filename;
+	FString OutputPath;
+	FParse::Value(*Params, TEXT("File="), Filename);
+	FParse::Value(*Params, TEXT("Output="), OutputPath);
+
+	TArray<uint8> Data;
+	if (Filename.IsEmpty() || !FFileHelper::LoadFileToArray(Data, *Filename))
+	{
+		UE_LOG(LogRunFromCamera, Error, TEXT("Replay needs -File=<session recording>, could not read '%s'"), *Filename);
+		return 1;
+	}
+
+	FMemoryReader Reader(Data);
+	FSessionRecordingHeader Header;
+	if (!Header.Serialize(Reader))
+	{
+		UE_LOG(LogRunFromCamera, Error, TEXT("%s is not a session recording of version %d"), *Filename, FSessionRecordingHeader::Version);
+		return 1;
+	}
+
+	if (OutputPath.IsEmpty())
+	{
+		OutputPath = FPaths::ProjectSavedDir() / TEXT("Benchmarks") / FString::Printf(TEXT("Replay-%s-%s.csv"), *FPaths::GetBaseFilename(Filename), *FDateTime::Now().ToString());
+	}
+
+	UPackage* MapPackage = LoadPackage(nullptr, *Header.MapName, LOAD_None);
+	UWorld* World = MapPackage ? UWorld::FindWorldInPackage(MapPackage) : nullptr;
+	UClass* PlayerClass = LoadClass<ARunFromCameraCharacter>(nullptr, *Header.PlayerClassPath);
+	if (!World || !PlayerClass)
+	{
+		UE_LOG(LogRunFromCamera, Error, TEXT("Replay could not load map %s or player %s"), *Header.MapName, *Header.PlayerClassPath);
+		return 1;
+	}
+
+	World->WorldType = EWorldType::Game;
+	World->AddToRoot();
+	FWorldContext& WorldContext = GEngine->CreateNewWorldContext(EWorldType::Game);
+	WorldContext.SetCurrentWorld(World);
+	World->InitWorld();
+
+	FURL URL;
+	World->SetGameMode(URL);
+	World->InitializeActorsForPlay(URL);
+
+	FActorSpawnParameters PlayerSpawnParams;
+	PlayerSpawnParams.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+	ARunFromCameraCharacter* Player = World->SpawnActor<ARunFromCameraCharacter>(PlayerClass, Header.PlayerLocation, Header.PlayerRotation, PlayerSpawnParams);
+
+	// A player controller, points, death and bullet cam all look for player controller 0
+	APlayerController* PlayerController = World->SpawnActor<APlayerController>();
+	if (!Player || !PlayerController)
+	{
+		UE_LOG(LogRunFromCamera, Error, TEXT("Replay could not spawn the player"));
+		GEngine->DestroyWorldContext(World);
+		World->DestroyWorld(false);
+		return 1;
+	}
+	PlayerController->Possess(Player);
+
+	// Same point as the recording, before any actor begins play
+	if (Header.bSeededAtBeginPlay)
+	{
+		FMath::RandInit(Header.Seed);
+		FMath::SRandInit(Header.Seed);
+	}
+
+	World->BeginPlay();
+
+	// The recording started late and was seeded right before its first recorded frame
+	if (!Header.bSeededAtBeginPlay)
+	{
+		UE_LOG(LogRunFromCamera, Warning, TEXT("%s was not recorded from begin play, random draws made before the first frame won't match"), *Filename);
+		FMath::RandInit(Header.Seed);
+		FMath::SRandInit(Header.Seed);
+	}
+
+	// Count what the replay produces, without writing anything
+	USessionRecordingSubsystem* SessionRecording = World->GetSubsystem<USessionRecordingSubsystem>();
+	if (SessionRecording)
+		SessionRecording->BeginRecording(Player, FString());
+
+	UE_LOG(LogRunFromCamera, Display, TEXT("Replaying %s on %s"), *Filename, *Header.MapName);
+
+	FString Csv = TEXT("Frame,Time,DeltaMs,GameThreadMs,Camera\n");
+	TArray<double> FrameTimes;
+	float Time = 0.f;
+	int32 Frame = 0;
+
+	FSessionRecord Record;
+	while (!Reader.AtEnd())
+	{
+		if (!Record.Serialize(Reader))
+		{
+			UE_LOG(LogRunFromCamera, Warning, TEXT("Replay stopped at a corrupt record, offset %lld"), Reader.Tell());
+			break;
+		}
+
+		if (FSessionRecord::IsGameplayEvent(Record.Type))
+		{
+			++RecordedEventCounts[(uint8)Record.Type];
+			continue;
+		}
+
+		if (Record.Type != ESessionRecordType::Frame)
+		{
+			ApplyRecord(Record, Player, PlayerController);
+			continue;
+		}
+
+		// Axis bindings fire every frame, but not while bullet cam has input disabled
+		if (IsValid(Player) && Player->GetCurrentCamera() != ECameraType::BulletCam)
+		{
+			Player->MoveForward(MoveForward);
+			Player->MoveRight(MoveRight);
+		}
+
+		const float DeltaSeconds = Record.Value / 1000000.f;
+		FApp::SetDeltaTime(DeltaSeconds);
+		FApp::SetCurrentTime(FApp::GetCurrentTime() + DeltaSeconds);
+		++GFrameCounter;
+
+		const double StartTime = FPlatformTime::Seconds();
+		World->Tick(LEVELTICK_All, DeltaSeconds);
+		const double GameThreadMs = (FPlatformTime::Seconds() - StartTime) * 1000.0;
+		FrameTimes.Add(GameThreadMs);
+
+		Csv += FString::Printf(TEXT("%d,%.4f,%.4f,%.4f,%s\n"), Frame, Time, DeltaSeconds * 1000.f, GameThreadMs,
+			IsValid(Player) ? *UEnum::GetValueAsString(Player->GetCurrentCamera()) : TEXT("None"));
+
+		Time += DeltaSeconds;
+		++Frame;
+	}
+
+	if (FFileHelper::SaveStringToFile(Csv, *OutputPath))
+	{
+		UE_LOG(LogRunFromCamera, Display, TEXT("Replay frame times written to %s"), *FPaths::ConvertRelativePathToFull(OutputPath));
+	}
+	else
+	{
+		UE_LOG(LogRunFromCamera, Error, TEXT("Replay could not write %s"), *OutputPath);
+	}
+
+	if (FrameTimes.Num() > 0)
+	{
+		double Total = 0.0;
+		for (double FrameTime : FrameTimes)
+			Total += FrameTime;
+
+		FrameTimes.Sort();
+		const double P95 = FrameTimes[FMath::Min(FMath::FloorToInt(FrameTimes.Num() * 0.95f), FrameTimes.Num() - 1)];
+		UE_LOG(LogRunFromCamera, Display, TEXT("Replay game thread: avg %.3f ms, p95 %.3f ms, max %.3f ms over %d frames (%.1f s of play)"),
+			Total / FrameTimes.Num(), P95, FrameTimes.Last(), FrameTimes.Num(), Time);
+	}
+
+	// Physics and AI are not bit exact, a replay that drifted too far is still a valid load but no longer the same session
+	if (SessionRecording)
+	{
+		for (uint8 Type = (uint8)ESessionRecordType::Shot; Type < (uint8)ESessionRecordType::Count; ++Type)
+		{
+			const int32 Replayed = SessionRecording->GetEventCount((ESessionRecordType)Type);
+			if (Replayed != RecordedEventCounts[Type])
+			{
+				UE_LOG(LogRunFromCamera, Warning, TEXT("Replay diverged: gameplay event %d recorded %d times, replayed %d times"), Type, RecordedEventCounts[Type], Replayed);
+			}
+		}
+		SessionRecording->EndRecording();
+	}
+
+	GEngine->DestroyWorldContext(World);
+	World->DestroyWorld(false);
+	World->RemoveFromRoot();
+
+	return 0;
+}
+
+void URunFromCameraReplayCommandlet::ApplyRecord(const FSessionRecord& Record, ARunFromCameraCharacter* Player, APlayerController* PlayerController)
+{
+	if (!IsValid(Player))
+		return;
+
+	switch (Record.Type)
+	{
+		case ESessionRecordType::MoveForward:
+			MoveForward = Record.Value / 127.f;
+			break;
+
+		case ESessionRecordType::MoveRight:
+			MoveRight = Record.Value / 127.f;
+			break;
+
+		case ESessionRecordType::ControlRotation:
+			PlayerController->SetControlRotation(Record.Rotation);
+			break;
+
+		case ESessionRecordType::Jump:
+			Player->Jump();
+			break;
+
+		case ESessionRecordType::StopJumping:
+			Player->StopJumping();
+			break;
+
+		case ESessionRecordType::ChangePOV:
+			Player->ChangePOV();
+			break;
+
+		case ESessionRecordType::Zoom:
+			Player->Zoom();
+			break;
+
+		case ESessionRecordType::StartSprint:
+			Player->StartSprint();
+			break;
+
+		case ESessionRecordType::StopSprint:
+			Player->StopSprint();
+			break;
+
+		case ESessionRecordType::FireDown:
+			Player->LeftMouseButtonDown();
+			break;
+
+		case ESessionRecordType::FireUp:
+			Player->Fire();
+			break;
+
+		default:
+			break;
+	}
+}
@@ -0,0 +1,42 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "SessionRecordingSubsystem.h"
+#include "RunFromCameraReplayCommandlet.generated.h"
+
+class APlayerController;
+class ARunFromCameraCharacter;
+
+/**
+ * Re-drives a session recorded with -RecordSession headless, as fast as the machine allows. The recorded map is
+ * loaded, the player is spawned where the recording started and every frame gets the recorded input and frame
+ * length. Frame times go to a CSV in Saved/Benchmarks like the benchmark commandlet's, so two builds can be compared
+ * on identical input. Gameplay events seen during the replay are checked against the recorded ones.
+ *
+ * UnrealEditor-Cmd RunFromCamera.uproject -run=RunFromCameraReplay -nullrhi -unattended -File=<recording>
+ *
+ * Optional: -Output=<file>
+ */
+UCLASS()
+class URunFromCameraReplayCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+	URunFromCameraReplayCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+	// Hands one recorded input record to the player, the way the input bindings would
+	void ApplyRecord(const FSessionRecord& Record, ARunFromCameraCharacter* Player, APlayerController* PlayerController);
+
+	float MoveForward = 0.f;
+
+	float MoveRight = 0.f;
+
+	int32 RecordedEventCounts[(uint8)ESessionRecordType::Count] = {};
+};
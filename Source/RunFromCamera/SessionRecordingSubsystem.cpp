@@ -0,0 +1,258 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "SessionRecordingSubsystem.h"
+#include "RunFromCamera.h"
+#include "RunFromCameraCharacter.h"
+#include "Engine/World.h"
+#include "HAL/FileManager.h"
+#include "Kismet/GameplayStatics.h"
+#include "Misc/CommandLine.h"
+#include "Misc/Paths.h"
+
+static TAutoConsoleVariable<bool> CVarRecordSession(
+	TEXT("RunFromCamera.Recording.Enabled"),
+	false,
+	TEXT("Record the player's input and gameplay events to Saved/Recordings. Same as running with -RecordSession."),
+	ECVF_Default);
+
+bool FSessionRecord::Serialize(FArchive& Ar)
+{
+	uint8 TypeByte = (uint8)Type;
+	Ar << TypeByte;
+	if (TypeByte >= (uint8)ESessionRecordType::Count)
+		return false;
+
+	Type = (ESessionRecordType)TypeByte;
+	switch (Type)
+	{
+		case ESessionRecordType::Frame:
+		case ESessionRecordType::Hit:
+		case ESessionRecordType::Points:
+		{
+			uint32 PackedValue = (uint32)Value;
+			Ar.SerializeIntPacked(PackedValue);
+			Value = (int32)PackedValue;
+			break;
+		}
+
+		case ESessionRecordType::MoveForward:
+		case ESessionRecordType::MoveRight:
+		{
+			int8 AxisValue = (int8)Value;
+			Ar << AxisValue;
+			Value = AxisValue;
+			break;
+		}
+
+		case ESessionRecordType::ControlRotation:
+		{
+			uint16 Pitch = FRotator::CompressAxisToShort(Rotation.Pitch);
+			uint16 Yaw = FRotator::CompressAxisToShort(Rotation.Yaw);
+			Ar << Pitch << Yaw;
+			Rotation = FRotator(FRotator::DecompressAxisFromShort(Pitch), FRotator::DecompressAxisFromShort(Yaw), 0.f);
+			break;
+		}
+
+		default:
+			break;
+	}
+
+	return !Ar.IsError();
+}
+
+bool FSessionRecordingHeader::Serialize(FArchive& Ar)
+{
+	uint32 FileMagic = Magic;
+	uint16 FileVersion = Version;
+	Ar << FileMagic << FileVersion;
+	if (FileMagic != Magic || FileVersion != Version)
+		return false;
+
+	Ar << MapName << PlayerClassPath << PlayerLocation << PlayerRotation << Seed << bSeededAtBeginPlay;
+	return !Ar.IsError();
+}
+
+void USessionRecordingSubsystem::Deinitialize()
+{
+	EndRecording();
+
+	Super::Deinitialize();
+}
+
+TStatId USessionRecordingSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(USessionRecordingSubsystem, STATGROUP_Tickables);
+}
+
+bool USessionRecordingSubsystem::DoesSupportWorldType(EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+bool USessionRecordingSubsystem::IsRecordingRequested()
+{
+	return CVarRecordSession.GetValueOnGameThread() || FParse::Param(FCommandLine::Get(), TEXT("RecordSession"));
+}
+
+void USessionRecordingSubsystem::BeginRecording(ARunFromCameraCharacter* InPlayer, const FString& Filename)
+{
+	if (IsRecording() || !InPlayer)
+		return;
+
+	if (!Filename.IsEmpty())
+	{
+		Writer.Reset(IFileManager::Get().CreateFileWriter(*Filename));
+		if (!Writer)
+		{
+			UE_LOG(LogRunFromCamera, Warning, TEXT("Could not create session recording %s"), *Filename);
+			return;
+		}
+
+		FSessionRecordingHeader Header;
+		Header.MapName = UWorld::RemovePIEPrefix(GetWorld()->GetOutermost()->GetName());
+		Header.PlayerClassPath = InPlayer->GetClass()->GetPathName();
+		Header.PlayerLocation = InPlayer->GetActorLocation();
+		Header.PlayerRotation = InPlayer->GetActorRotation();
+
+		// Turret AI draws from the global random stream, the replay seeds it at the same point. A recording that
+		// starts after the world's first frame can't cover what came before, it says so and seeds here instead.
+		Header.bSeededAtBeginPlay = bSeededAtBeginPlay && NumFramesBeforeRecording == 0;
+		if (!Header.bSeededAtBeginPlay)
+		{
+			if (bSeededAtBeginPlay)
+				UE_LOG(LogRunFromCamera, Warning, TEXT("Session recording starts %d frames after begin play, the replay won't cover them"), NumFramesBeforeRecording);
+
+			RecordingSeed = FMath::Rand();
+			FMath::RandInit(RecordingSeed);
+			FMath::SRandInit(RecordingSeed);
+		}
+		Header.Seed = RecordingSeed;
+
+		Header.Serialize(*Writer);
+
+		UE_LOG(LogRunFromCamera, Display, TEXT("Recording session to %s"), *FPaths::ConvertRelativePathToFull(Filename));
+	}
+
+	Player = InPlayer;
+	LastMoveForward = 0;
+	LastMoveRight = 0;
+	LastPitch = INDEX_NONE;
+	LastYaw = INDEX_NONE;
+	FMemory::Memzero(EventCounts);
+}
+
+void USessionRecordingSubsystem::EndRecording()
+{
+	if (Writer)
+	{
+		const int64 Size = Writer->TotalSize();
+		Writer->Close();
+		Writer.Reset();
+
+		UE_LOG(LogRunFromCamera, Display, TEXT("Session recording closed: %lld bytes, %d shots, %d hits, %d bullet cams"), Size,
+			GetEventCount(ESessionRecordType::Shot), GetEventCount(ESessionRecordType::Hit), GetEventCount(ESessionRecordType::BulletCamStart));
+	}
+
+	Player.Reset();
+}
+
+void USessionRecordingSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	if (!IsRecordingRequested())
+		return;
+
+	// Runs before any actor begins play, the replay seeds right before its World->BeginPlay so both streams line up
+	RecordingSeed = FMath::Rand();
+	FMath::RandInit(RecordingSeed);
+	FMath::SRandInit(RecordingSeed);
+	bSeededAtBeginPlay = true;
+
+	// The standalone player is spawned before begin play, recording from here covers the very first frame
+	StartRequestedRecording();
+}
+
+void USessionRecordingSubsystem::StartRequestedRecording()
+{
+	if (bRequestedRecordingStarted || !IsRecordingRequested())
+		return;
+
+	if (ARunFromCameraCharacter* PlayerCharacter = Cast<ARunFromCameraCharacter>(UGameplayStatics::GetPlayerPawn(this, 0)))
+	{
+		bRequestedRecordingStarted = true;
+		BeginRecording(PlayerCharacter, FPaths::ProjectSavedDir() / TEXT("Recordings") / FString::Printf(TEXT("Session-%s.rfcsession"), *FDateTime::Now().ToString()));
+	}
+}
+
+void USessionRecordingSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if (!bRequestedRecordingStarted)
+	{
+		++NumFramesBeforeRecording;
+		StartRequestedRecording();
+	}
+
+	ARunFromCameraCharacter* PlayerCharacter = Player.Get();
+	if (!PlayerCharacter || !Writer)
+		return;
+
+	// Mouse and gamepad look both end up in the control rotation, recording it covers every device
+	FSessionRecord Record;
+	Record.Rotation = PlayerCharacter->GetControlRotation();
+	const int32 Pitch = FRotator::CompressAxisToShort(Record.Rotation.Pitch);
+	const int32 Yaw = FRotator::CompressAxisToShort(Record.Rotation.Yaw);
+	if (Pitch != LastPitch || Yaw != LastYaw)
+	{
+		LastPitch = Pitch;
+		LastYaw = Yaw;
+		Record.Type = ESessionRecordType::ControlRotation;
+		Write(Record);
+	}
+
+	// The undilated frame length, which is what the replay hands to World->Tick
+	Record.Type = ESessionRecordType::Frame;
+	Record.Value = FMath::Max(FMath::RoundToInt(FApp::GetDeltaTime() * 1000000.0), 0);
+	Write(Record);
+}
+
+void USessionRecordingSubsystem::RecordAxis(ESessionRecordType Type, float Value)
+{
+	if (!IsRecording())
+		return;
+
+	const int32 AxisValue = FMath::Clamp(FMath::RoundToInt(Value * 127.f), -127, 127);
+	int32& LastValue = Type == ESessionRecordType::MoveForward ? LastMoveForward : LastMoveRight;
+	if (AxisValue == LastValue)
+		return;
+
+	LastValue = AxisValue;
+
+	FSessionRecord Record;
+	Record.Type = Type;
+	Record.Value = AxisValue;
+	Write(Record);
+}
+
+void USessionRecordingSubsystem::Record(ESessionRecordType Type, int32 Value)
+{
+	if (!IsRecording())
+		return;
+
+	FSessionRecord Record;
+	Record.Type = Type;
+	Record.Value = Value;
+	Write(Record);
+}
+
+void USessionRecordingSubsystem::Write(FSessionRecord& Record)
+{
+	if (FSessionRecord::IsGameplayEvent(Record.Type))
+		++EventCounts[(uint8)Record.Type];
+
+	if (Writer)
+		Record.Serialize(*Writer);
+}
@@ -0,0 +1,155 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "SessionRecordingSubsystem.generated.h"
+
+class ARunFromCameraCharacter;
+
+/**
+ * Everything a session recording holds after its header, one byte of type followed by the payload.
+ */
+enum class ESessionRecordType : uint8
+{
+	// Closes a frame, payload is the frame length in microseconds (packed)
+	Frame,
+
+	// Axis input, payload is the value scaled to -127..127
+	MoveForward,
+	MoveRight,
+
+	// Payload is pitch and yaw compressed to 16 bits each, only written when it changed
+	ControlRotation,
+
+	Jump,
+	StopJumping,
+	ChangePOV,
+	Zoom,
+	StartSprint,
+	StopSprint,
+	FireDown,
+	FireUp,
+
+	// Gameplay events. They are not replayed, a replay produces its own and compares how many of each it saw.
+	Shot,
+	// Payload is 0 for a turret hit, 1 for the player being hit
+	Hit,
+	BulletCamStart,
+	BulletCamEnd,
+	// Payload is the amount (packed)
+	Points,
+	Die,
+
+	Count
+};
+
+struct FSessionRecord
+{
+	ESessionRecordType Type = ESessionRecordType::Frame;
+
+	int32 Value = 0;
+
+	FRotator Rotation = FRotator::ZeroRotator;
+
+	// Reads or writes one record. Returns false on an unknown type.
+	bool Serialize(FArchive& Ar);
+
+	static bool IsGameplayEvent(ESessionRecordType Type) { return Type >= ESessionRecordType::Shot && Type < ESessionRecordType::Count; }
+};
+
+struct FSessionRecordingHeader
+{
+	static constexpr uint32 Magic = 0x53434652;
+
+	static constexpr uint16 Version = 2;
+
+	FString MapName;
+
+	FString PlayerClassPath;
+
+	FVector PlayerLocation = FVector::ZeroVector;
+
+	FRotator PlayerRotation = FRotator::ZeroRotator;
+
+	int32 Seed = 0;
+
+	// True when the seed was applied before any actor began play and the first frame is recorded. Otherwise it was
+	// applied when the recording started, and whatever ran before that is not part of the recording.
+	bool bSeededAtBeginPlay = false;
+
+	// Returns false when a loaded file is not a recording of this version
+	bool Serialize(FArchive& Ar);
+};
+
+/**
+ * Writes the player's input and the key gameplay events of a session to Saved/Recordings, so the exact session can be
+ * re-driven headless by the RunFromCameraReplay commandlet. Starts with the player when the game runs with
+ * -RecordSession or RunFromCamera.Recording.Enabled is on.
+ */
+UCLASS()
+class RUNFROMCAMERA_API USessionRecordingSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Deinitialize() override;
+
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual TStatId GetStatId() const override;
+
+	// True when the session should be recorded without being asked to
+	static bool IsRecordingRequested();
+
+	// Starts writing to Filename. An empty Filename only counts gameplay events, which is what a replay does.
+	void BeginRecording(ARunFromCameraCharacter* InPlayer, const FString& Filename);
+
+	void EndRecording();
+
+	bool IsRecording() const { return Player.IsValid(); }
+
+	// Axis values are only written when they change
+	void RecordAxis(ESessionRecordType Type, float Value);
+
+	void Record(ESessionRecordType Type, int32 Value = 0);
+
+	int32 GetEventCount(ESessionRecordType Type) const { return EventCounts[(uint8)Type]; }
+
+protected:
+	virtual bool DoesSupportWorldType(EWorldType::Type WorldType) const override;
+
+private:
+	void Write(FSessionRecord& Record);
+
+	// Starts a recording asked for by -RecordSession once there is a player pawn
+	void StartRequestedRecording();
+
+	TWeakObjectPtr<ARunFromCameraCharacter> Player;
+
+	TUniquePtr<FArchive> Writer;
+
+	// A requested recording starts with the first player pawn and only once per world
+	bool bRequestedRecordingStarted = false;
+
+	bool bSeededAtBeginPlay = false;
+
+	int32 RecordingSeed = 0;
+
+	// Frames that went by between world begin play and a requested recording starting
+	int32 NumFramesBeforeRecording = 0;
+
+	// Last values written, already quantized. INDEX_NONE forces the first write.
+	int32 LastMoveForward = 0;
+
+	int32 LastMoveRight = 0;
+
+	int32 LastPitch = INDEX_NONE;
+
+	int32 LastYaw = INDEX_NONE;
+
+	int32 EventCounts[(uint8)ESessionRecordType::Count] = {};
+};
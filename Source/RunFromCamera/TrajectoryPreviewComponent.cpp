@@ -0,0 +1,239 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+
+#include "TrajectoryPreviewComponent.h"
+#include "RunFromCamera.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Engine/StaticMesh.h"
+#include "Materials/MaterialInstanceDynamic.h"
+#include "UObject/ConstructorHelpers.h"
+
+DECLARE_CYCLE_STAT(TEXT("Trajectory Preview Update"), STAT_TrajectoryPreviewUpdate, STATGROUP_RunFromCamera);
+
+namespace
+{
+	// Size of the engine basic shapes
+	const float BasicShapeSize = 100.f;
+}
+
+// Sets default values for this component's properties
+UTrajectoryPreviewComponent::UTrajectoryPreviewComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+
+	static ConstructorHelpers::FObjectFinder<UStaticMesh>Cylinder(TEXT("StaticMesh'/Engine/BasicShapes/Cylinder.Cylinder'"));
+	if (Cylinder.Succeeded())
+	{
+		SegmentMesh = Cylinder.Object;
+	}
+
+	static ConstructorHelpers::FObjectFinder<UStaticMesh>Sphere(TEXT("StaticMesh'/Engine/BasicShapes/Sphere.Sphere'"));
+	if (Sphere.Succeeded())
+	{
+		MarkerMesh = Sphere.Object;
+	}
+
+	SegmentMaterial = nullptr;
+	MarkerMaterial = nullptr;
+
+	// Has a Color parameter, which is all it takes to get the old debug draw colours back
+	static ConstructorHelpers::FObjectFinder<UMaterialInterface>BasicShapeMaterial(TEXT("Material'/Engine/BasicShapes/BasicShapeMaterial.BasicShapeMaterial'"));
+	if (BasicShapeMaterial.Succeeded())
+	{
+		SegmentMaterial = BasicShapeMaterial.Object;
+		MarkerMaterial = BasicShapeMaterial.Object;
+	}
+
+	MarkerInstances = nullptr;
+}
+
+void UTrajectoryPreviewComponent::OnRegister()
+{
+	Super::OnRegister();
+
+	// Nothing to look at on a server or in the editor preview of the owner
+	UWorld* World = GetWorld();
+	if (!World || !World->IsGameWorld() || !FApp::CanEverRender())
+		return;
+
+	if (SegmentInstances.Num() == 0)
+	{
+		// Only one segment ends in the impact, the others take turns
+		const int32 NumPreallocated = FMath::Max(PreallocatedSegments, 0);
+		SegmentInstances.SetNum(NumSegmentColors);
+		SegmentInstances[EvenSegment] = CreateInstancedMesh(SegmentMesh, SegmentMaterial, SegmentColor, (NumPreallocated + 1) / 2);
+		SegmentInstances[OddSegment] = CreateInstancedMesh(SegmentMesh, SegmentMaterial, AlternateSegmentColor, NumPreallocated / 2);
+		SegmentInstances[ImpactSegment] = CreateInstancedMesh(SegmentMesh, SegmentMaterial, ImpactSegmentColor, FMath::Min(NumPreallocated, 1));
+	}
+
+	if (!MarkerInstances)
+		MarkerInstances = CreateInstancedMesh(MarkerMesh, MarkerMaterial, MarkerColor, FMath::Max(PreallocatedSegments, 0));
+}
+
+void UTrajectoryPreviewComponent::OnUnregister()
+{
+	for (UInstancedStaticMeshComponent* Instances : SegmentInstances)
+	{
+		if (Instances)
+			Instances->DestroyComponent();
+	}
+	SegmentInstances.Reset();
+
+	if (MarkerInstances)
+	{
+		MarkerInstances->DestroyComponent();
+		MarkerInstances = nullptr;
+	}
+
+	ShownPoints.Reset();
+	FMemory::Memzero(NumSegmentsShown);
+	NumMarkersShown = 0;
+	bPathVisible = false;
+
+	Super::OnUnregister();
+}
+
+UInstancedStaticMeshComponent* UTrajectoryPreviewComponent::CreateInstancedMesh(UStaticMesh* Mesh, UMaterialInterface* Material, const FLinearColor& Color, int32 NumPreallocated)
+{
+	if (!Mesh)
+		return nullptr;
+
+	UInstancedStaticMeshComponent* Instances = NewObject<UInstancedStaticMeshComponent>(GetOwner(), NAME_None, RF_Transient);
+	Instances->SetStaticMesh(Mesh);
+	if (Material && !ColorParameterName.IsNone())
+	{
+		UMaterialInstanceDynamic* TintedMaterial = UMaterialInstanceDynamic::Create(Material, Instances);
+		TintedMaterial->SetVectorParameterValue(ColorParameterName, Color);
+		Instances->SetMaterial(0, TintedMaterial);
+	}
+	else if (Material)
+	{
+		Instances->SetMaterial(0, Material);
+	}
+
+	Instances->SetMobility(EComponentMobility::Movable);
+	Instances->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	Instances->SetCanEverAffectNavigation(false);
+	Instances->SetCastShadow(false);
+
+	// Instance transforms are given in world space, the owner moving around must not drag the path along
+	Instances->SetupAttachment(this);
+	Instances->SetUsingAbsoluteLocation(true);
+	Instances->SetUsingAbsoluteRotation(true);
+	Instances->SetUsingAbsoluteScale(true);
+	Instances->SetWorldTransform(FTransform::Identity);
+	Instances->SetVisibility(false);
+	Instances->RegisterComponent();
+
+	InstanceTransforms.Reset();
+	InstanceTransforms.Init(FTransform(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector), NumPreallocated);
+	Instances->AddInstances(InstanceTransforms, false, true);
+
+	return Instances;
+}
+
+void UTrajectoryPreviewComponent::ShowPath(TArrayView<const FVector> Points)
+{
+	if (Points.Num() < 2)
+	{
+		HidePath();
+		return;
+	}
+
+	const bool bSamePath = bPathVisible && ShownPoints.Num() == Points.Num()
+		&& FMemory::Memcmp(ShownPoints.GetData(), Points.GetData(), Points.Num() * sizeof(FVector)) == 0;
+	if (bSamePath)
+		return;
+
+	RUNFROMCAMERA_SCOPE_CYCLE_COUNTER(STAT_TrajectoryPreviewUpdate);
+
+	ShownPoints.Reset();
+	ShownPoints.Append(Points.GetData(), Points.Num());
+
+	const int32 NumSegments = Points.Num() - 1;
+
+	const FVector SegmentScale(SegmentThickness / BasicShapeSize, SegmentThickness / BasicShapeSize, 1.f);
+	for (int32 Color = 0; Color < SegmentInstances.Num(); ++Color)
+	{
+		UInstancedStaticMeshComponent* Instances = SegmentInstances[Color];
+		if (!Instances)
+			continue;
+
+		InstanceTransforms.Reset();
+		for (int32 Segment = 0; Segment < NumSegments; ++Segment)
+		{
+			const int32 SegmentColorIndex = Segment == NumSegments - 1 ? ImpactSegment : (Segment % 2 == 0 ? EvenSegment : OddSegment);
+			if (SegmentColorIndex != Color)
+				continue;
+
+			const FVector Start = Points[Segment];
+			const FVector Delta = Points[Segment + 1] - Start;
+			const float Length = Delta.Size();
+
+			// The cylinder is centered on its pivot and points up Z
+			FTransform& Transform = InstanceTransforms.AddDefaulted_GetRef();
+			Transform.SetLocation(Start + Delta * 0.5f);
+			Transform.SetRotation(FRotationMatrix::MakeFromZ(Length > KINDA_SMALL_NUMBER ? Delta / Length : FVector::UpVector).ToQuat());
+			Transform.SetScale3D(SegmentScale * FVector(1.f, 1.f, Length / BasicShapeSize));
+		}
+		UpdateInstances(Instances, InstanceTransforms.Num(), NumSegmentsShown[Color]);
+	}
+
+	if (MarkerInstances)
+	{
+		InstanceTransforms.Reset();
+		for (int32 Point = 1; Point < Points.Num(); ++Point)
+		{
+			const float Radius = Point == Points.Num() - 1 ? ImpactMarkerRadius : BounceMarkerRadius;
+			InstanceTransforms.Emplace(FQuat::Identity, Points[Point], FVector(Radius * 2.f / BasicShapeSize));
+		}
+		UpdateInstances(MarkerInstances, NumSegments, NumMarkersShown);
+	}
+
+	if (!bPathVisible)
+	{
+		for (UInstancedStaticMeshComponent* Instances : SegmentInstances)
+		{
+			if (Instances)
+				Instances->SetVisibility(true);
+		}
+		if (MarkerInstances)
+			MarkerInstances->SetVisibility(true);
+		bPathVisible = true;
+	}
+}
+
+void UTrajectoryPreviewComponent::HidePath()
+{
+	if (!bPathVisible)
+		return;
+
+	// Instances keep their transforms, showing the same path again is free
+	for (UInstancedStaticMeshComponent* Instances : SegmentInstances)
+	{
+		if (Instances)
+			Instances->SetVisibility(false);
+	}
+	if (MarkerInstances)
+		MarkerInstances->SetVisibility(false);
+	bPathVisible = false;
+}
+
+void UTrajectoryPreviewComponent::UpdateInstances(UInstancedStaticMeshComponent* Instances, int32 NumUsed, int32& NumShown)
+{
+	// Leftovers from a longer path are collapsed instead of removed, so the instance buffer never shrinks and regrows
+	const FTransform Collapsed(FQuat::Identity, FVector::ZeroVector, FVector::ZeroVector);
+	for (int32 Index = NumUsed; Index < NumShown; ++Index)
+	{
+		InstanceTransforms.Add(Collapsed);
+	}
+
+	const int32 NumToAdd = InstanceTransforms.Num() - Instances->GetInstanceCount();
+	for (int32 Index = 0; Index < NumToAdd; ++Index)
+	{
+		Instances->AddInstance(Collapsed, true);
+	}
+
+	Instances->BatchUpdateInstancesTransforms(0, InstanceTransforms, true, true, true);
+	NumShown = NumUsed;
+}
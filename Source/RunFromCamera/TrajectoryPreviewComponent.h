@@ -0,0 +1,118 @@
+// Fill out your copyright notice in the Description page of Project Settings.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SceneComponent.h"
+#include "TrajectoryPreviewComponent.generated.h"
+
+class UInstancedStaticMeshComponent;
+class UMaterialInterface;
+class UStaticMesh;
+
+/**
+ * Draws a ricochet path with instanced meshes, one instance per segment and one per impact marker. Segments are
+ * split over one instanced mesh per colour, so the default material only needs a colour parameter.
+ * Instances are created up front and only their transforms change when the path does, so showing the same
+ * path every frame costs nothing and a new path costs one batched transform update per mesh.
+ */
+UCLASS(ClassGroup = (Custom), meta = (BlueprintSpawnableComponent))
+class RUNFROMCAMERA_API UTrajectoryPreviewComponent : public USceneComponent
+{
+	GENERATED_BODY()
+
+public:
+	// Sets default values for this component's properties
+	UTrajectoryPreviewComponent();
+
+	// Shows the path through Points, the last point gets the bigger impact marker
+	void ShowPath(TArrayView<const FVector> Points);
+
+	void HidePath();
+
+	bool IsPathVisible() const { return bPathVisible; }
+
+	// Stretched along the segment, expected to be 100 units long on Z and 100 units wide like the engine cylinder
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Trajectory Preview")
+	UStaticMesh* SegmentMesh;
+
+	// Tinted through ColorParameterName, the engine basic shape material by default
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Trajectory Preview")
+	UMaterialInterface* SegmentMaterial;
+
+	// Expected to be 100 units across like the engine sphere
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Trajectory Preview")
+	UStaticMesh* MarkerMesh;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Trajectory Preview")
+	UMaterialInterface* MarkerMaterial;
+
+	// Vector parameter of both materials that takes the colours below, None leaves the materials as they are
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Trajectory Preview")
+	FName ColorParameterName = TEXT("Color");
+
+	// Segments alternate between these two so every bounce stands out
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Trajectory Preview")
+	FLinearColor SegmentColor = FLinearColor::Green;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Trajectory Preview")
+	FLinearColor AlternateSegmentColor = FLinearColor::Blue;
+
+	// The segment ending in the impact
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Trajectory Preview")
+	FLinearColor ImpactSegmentColor = FLinearColor::Red;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Trajectory Preview")
+	FLinearColor MarkerColor = FLinearColor::Red;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Trajectory Preview")
+	float SegmentThickness = 2.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Trajectory Preview")
+	float BounceMarkerRadius = 10.f;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Trajectory Preview")
+	float ImpactMarkerRadius = 15.f;
+
+	// Instances created when the component registers. Longer paths add more on demand.
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Trajectory Preview")
+	int32 PreallocatedSegments = 8;
+
+protected:
+	virtual void OnRegister() override;
+
+	virtual void OnUnregister() override;
+
+private:
+	UInstancedStaticMeshComponent* CreateInstancedMesh(UStaticMesh* Mesh, UMaterialInterface* Material, const FLinearColor& Color, int32 NumPreallocated);
+
+	// Transforms of the first NumUsed instances are taken from InstanceTransforms, the rest are collapsed to zero scale
+	void UpdateInstances(UInstancedStaticMeshComponent* Instances, int32 NumUsed, int32& NumShown);
+
+	enum ESegmentColor
+	{
+		EvenSegment,
+		OddSegment,
+		ImpactSegment,
+		NumSegmentColors
+	};
+
+	// One instanced mesh per ESegmentColor
+	UPROPERTY(Transient)
+	TArray<UInstancedStaticMeshComponent*> SegmentInstances;
+
+	UPROPERTY(Transient)
+	UInstancedStaticMeshComponent* MarkerInstances;
+
+	// Path currently shown, to skip updates when it didn't change
+	TArray<FVector> ShownPoints;
+
+	// Reused for every update so a new path doesn't allocate
+	TArray<FTransform> InstanceTransforms;
+
+	int32 NumSegmentsShown[NumSegmentColors] = {};
+
+	int32 NumMarkersShown = 0;
+
+	bool bPathVisible = false;
+};